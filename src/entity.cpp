@@ -1,51 +1,15 @@
 #include "entity.h"
 
-#include <random>
 #include "renderer.h"
 #include "physics.h"
+#include "softbody_batch.h"
 
-void RenderSoftbody(const PhysicsSoftBody& softbody, unsigned int texIdx) {
-    std::array<b2Vec2, 6> vertices;
-    for (int i = 0; i < g_softbodyVertices.size(); i++) {
-        vertices[i] = softbody.vertices[i].GetPosition();
-    }
-    b2Vec2 center = b2Vec2_zero;
-    for (const auto& v : vertices) {
-        center = b2Add(center, v);
-    }
-    center = b2MulSV(1.0f / vertices.size(), center);
-
-    RendererTriangle triangle;
-
-    triangle.points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .u = 0.0f, .v = 1.0f, .texIdx = texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[1].x, .y = vertices[1].y, .u = 1.0f, .v = 1.0f, .texIdx = texIdx };
-    triangle.points[2] = RendererVertex{ .x =      center.x, .y =      center.y, .u = 0.5f, .v = 0.5f, .texIdx = texIdx };
-    Renderer::GetInstance().PushTriangle(triangle);
-
-    triangle.points[0] = RendererVertex{ .x = vertices[1].x, .y = vertices[1].y, .u = 1.0f, .v = 1.0f, .texIdx = texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .u = 1.0f, .v = 0.5f, .texIdx = texIdx };
-    triangle.points[2] = RendererVertex{ .x =      center.x, .y =      center.y, .u = 0.5f, .v = 0.5f, .texIdx = texIdx };
-    Renderer::GetInstance().PushTriangle(triangle);
-
-    triangle.points[0] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .u = 1.0f, .v = 0.5f, .texIdx = texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[3].x, .y = vertices[3].y, .u = 1.0f, .v = 0.0f, .texIdx = texIdx };
-    triangle.points[2] = RendererVertex{ .x =      center.x, .y =      center.y, .u = 0.5f, .v = 0.5f, .texIdx = texIdx };
-    Renderer::GetInstance().PushTriangle(triangle);
-
-    triangle.points[0] = RendererVertex{ .x = vertices[3].x, .y = vertices[3].y, .u = 1.0f, .v = 0.0f, .texIdx = texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[4].x, .y = vertices[4].y, .u = 0.0f, .v = 0.0f, .texIdx = texIdx };
-    triangle.points[2] = RendererVertex{ .x =      center.x, .y =      center.y, .u = 0.5f, .v = 0.5f, .texIdx = texIdx };
-    Renderer::GetInstance().PushTriangle(triangle);
-
-    triangle.points[0] = RendererVertex{ .x = vertices[4].x, .y = vertices[4].y, .u = 0.0f, .v = 0.0f, .texIdx = texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[5].x, .y = vertices[5].y, .u = 0.0f, .v = 0.5f, .texIdx = texIdx };
-    triangle.points[2] = RendererVertex{ .x =      center.x, .y =      center.y, .u = 0.5f, .v = 0.5f, .texIdx = texIdx };
-    Renderer::GetInstance().PushTriangle(triangle);
+static_assert(g_softbodyVertices.size() == SOFTBODY_VERTEX_COUNT);
 
-    triangle.points[0] = RendererVertex{ .x = vertices[5].x, .y = vertices[5].y, .u = 0.0f, .v = 0.5f, .texIdx = texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .u = 0.0f, .v = 1.0f, .texIdx = texIdx };
-    triangle.points[2] = RendererVertex{ .x =      center.x, .y =      center.y, .u = 0.5f, .v = 0.5f, .texIdx = texIdx };
-    Renderer::GetInstance().PushTriangle(triangle);
+static const PhysicsSoftBodyTemplate& GetSoftbodyTemplate() {
+    static const PhysicsSoftBodyTemplate softbodyTemplate =
+        Physics::MakeSoftBodyTemplate(g_softbodyVertices, g_softbodyConnections);
+    return softbodyTemplate;
 }
 
 Entity::Entity(Platform& platform, Physics& physics, unsigned int m_texIdx)
@@ -55,69 +19,100 @@ Entity::Entity(Platform& platform, Physics& physics, unsigned int m_texIdx)
 Wall::Wall(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos, b2Vec2 size)
     : Entity(platform, physics, texIdx)
 {
-    m_physicsObject = m_physicsRef.CreateBox(pos, size);
+    b2Vec2 halfSize = b2MulSV(0.5f, size);
+    m_vertices = {
+        b2Vec2{ pos.x - halfSize.x, pos.y - halfSize.y },
+        b2Vec2{ pos.x + halfSize.x, pos.y - halfSize.y },
+        b2Vec2{ pos.x + halfSize.x, pos.y + halfSize.y },
+        b2Vec2{ pos.x - halfSize.x, pos.y + halfSize.y }
+    };
 }
 
 void Wall::Render() {
-    std::vector<b2Vec2> vertices = m_physicsObject.GetWorldVertices();
+    const std::array<b2Vec2, 4>& vertices = m_vertices;
     float width = abs(vertices[0].x - vertices[1].x) * 0.5f;
     float height = abs(vertices[1].y - vertices[2].y) * 0.5f;
-    RendererTriangle triangle;
-    triangle.points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .texIdx = m_texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[1].x, .y = vertices[1].y, .texIdx = m_texIdx };
-    triangle.points[2] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .texIdx = m_texIdx };
-    triangle.points[0].u = 0;     triangle.points[0].v = height;
-    triangle.points[1].u = width; triangle.points[1].v = height;
-    triangle.points[2].u = width; triangle.points[2].v = 0;
-    Renderer::GetInstance().PushTriangle(triangle);
-    triangle.points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .texIdx = m_texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .texIdx = m_texIdx };
-    triangle.points[2] = RendererVertex{ .x = vertices[3].x, .y = vertices[3].y, .texIdx = m_texIdx };
-    triangle.points[0].u = 0;     triangle.points[0].v = height;
-    triangle.points[1].u = width; triangle.points[1].v = 0;
-    triangle.points[2].u = 0;     triangle.points[2].v = 0;
-    Renderer::GetInstance().PushTriangle(triangle);
-}
-
-Player::Player(Platform& platform, Physics& physics, unsigned int m_texIdx)
-    : Entity(platform, physics, m_texIdx)
+    std::span<RendererTriangle> triangles = Renderer::GetInstance().ReserveTriangles(2);
+    triangles[0].points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .u = 0,     .v = height, .texIdx = m_texIdx };
+    triangles[0].points[1] = RendererVertex{ .x = vertices[1].x, .y = vertices[1].y, .u = width, .v = height, .texIdx = m_texIdx };
+    triangles[0].points[2] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .u = width, .v = 0,      .texIdx = m_texIdx };
+    triangles[1].points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .u = 0,     .v = height, .texIdx = m_texIdx };
+    triangles[1].points[1] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .u = width, .v = 0,      .texIdx = m_texIdx };
+    triangles[1].points[2] = RendererVertex{ .x = vertices[3].x, .y = vertices[3].y, .u = 0,     .v = 0,      .texIdx = m_texIdx };
+}
+
+LevelGeometry::LevelGeometry(Platform& platform, Physics& physics, unsigned int texIdx, const LevelGeometryBuilder& builder)
+    : Entity(platform, physics, texIdx)
 {
-    m_physicsObject = m_physicsRef.CreateSoftBody(
-        b2Vec2{ 5.0f, 1.0f }, g_softbodyVertices, g_softbodyConnections);
+    std::vector<std::vector<b2Vec2>> outlines = builder.BuildOutlines();
+    m_physicsObject = m_physicsRef.CreateChainBody(outlines, PHYSICS_CATEGORY_WALL);
+    m_physicsObject.SetUserData(static_cast<Entity*>(this));
+}
+
+Player::Player(Platform& platform, Physics& physics, unsigned int m_texIdx, PlayerController controller)
+    : Entity(platform, physics, m_texIdx), m_controller(controller)
+{
+    b2Vec2 position{ 5.0f, 1.0f };
+    m_physicsObject = m_physicsRef.CreateSoftBody(position, GetSoftbodyTemplate(), PHYSICS_CATEGORY_PLAYER);
+    m_physicsObject.SetUserData(static_cast<Entity*>(this));
+    if (m_controller == PLAYER_CONTROLLER_MOVER) {
+        // With the mass of one vertex, an impulse changes the velocity as much as it did for the softbody
+        m_mover = m_physicsRef.CreateMover(position, g_playerCapsule, m_physicsObject.vertices[0].GetMass(), PHYSICS_CATEGORY_PLAYER);
+        m_mover.SetUserData(static_cast<Entity*>(this));
+        m_physicsRef.AttachVisualSoftBody(m_mover, m_physicsObject, g_softbodyVertices);
+    }
 }
 
 void Player::Render() {
-    RenderSoftbody(m_physicsObject, m_texIdx);
+    SoftbodyBatch::GetInstance().Push(m_physicsRef, m_physicsObject, m_texIdx);
 }
 
 void Player::Update() {
 }
 
 b2Vec2 Player::GetPosition() {
-    return m_physicsObject.vertices[0].GetPosition();
+    if (m_controller == PLAYER_CONTROLLER_MOVER)
+        return m_physicsRef.GetPosition(m_mover.Id);
+    return m_physicsRef.GetPosition(m_physicsObject.vertices[0].Id);
 }
 
 void Player::ApplyImpulse(float x, float y) {
-    m_physicsObject.ApplyImpulse(x, y);
+    if (m_controller == PLAYER_CONTROLLER_MOVER)
+        m_physicsRef.ApplyMoverImpulse(m_mover, b2Vec2{ x, y });
+    else
+        m_physicsObject.ApplyImpulse(x, y);
 }
 
-Enemy::Enemy(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos)
-    : Entity(platform, physics, texIdx)
+// Uniform in [-1, 1); std::uniform_real_distribution is implementation defined,
+// this gives the same values with every standard library
+static float RandomSigned(std::mt19937& rng) {
+    return (float)(rng() >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+Enemy::Enemy(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos, uint32_t seed)
+    : Entity(platform, physics, texIdx), m_rng(seed)
+{
+    m_physicsObject = m_physicsRef.CreateSoftBody(pos, GetSoftbodyTemplate(), PHYSICS_CATEGORY_ENEMY);
+    m_physicsObject.SetUserData(static_cast<Entity*>(this));
+}
+
+Enemy::Enemy(Platform& platform, Physics& physics, unsigned int texIdx, PhysicsSoftBody&& softBody, uint32_t seed)
+    : Entity(platform, physics, texIdx), m_physicsObject(std::move(softBody)), m_rng(seed)
 {
-    m_physicsObject = m_physicsRef.CreateSoftBody(
-        pos, g_softbodyVertices, g_softbodyConnections);
+    m_physicsObject.SetUserData(static_cast<Entity*>(this));
 }
 
 void Enemy::Render() {
-    RenderSoftbody(m_physicsObject, m_texIdx);
+    SoftbodyBatch::GetInstance().Push(m_physicsRef, m_physicsObject, m_texIdx);
 }
 
 void Enemy::Update() {
-    std::random_device device;
-    std::mt19937 rng(device());
-    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    // Dead enemies stop wandering around, resting ones until something hits them
+    if (m_health <= 0 || m_wanderFrames <= 0)
+        return;
+    m_wanderFrames--;
 
-    b2Vec2 randomDir{ .x = dist(rng), .y = dist(rng) };
+    b2Vec2 randomDir{ .x = RandomSigned(m_rng), .y = RandomSigned(m_rng) };
     randomDir = b2Normalize(randomDir);
 
     m_physicsObject.ApplyImpulse(
@@ -126,35 +121,115 @@ void Enemy::Update() {
     );
 }
 
-Bullet::Bullet(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos, b2Vec2 dir)
+void Enemy::OnHit(Entity& other) {
+    Bullet* pBullet = dynamic_cast<Bullet*>(&other);
+    bool isBulletHit = pBullet != nullptr && pBullet->IsActive();
+    bool isHitscanHit = dynamic_cast<HitscanWeapon*>(&other) != nullptr;
+    if (isBulletHit || isHitscanHit) {
+        m_health--;
+        m_wanderFrames = ENEMY_WANDER_FRAMES;
+    }
+}
+
+Bullet::Bullet(Platform& platform, Physics& physics, unsigned int texIdx)
     : Entity(platform, physics, texIdx)
 {
-    m_physicsObject = physics.CreateCircle(pos, BULLET_RADIUS, true);
+    m_physicsObject = physics.CreateCircle(g_bulletBounds.lowerBound, BULLET_RADIUS, true, true, PHYSICS_CATEGORY_BULLET);
+    m_physicsObject.SetUserData(static_cast<Entity*>(this));
+    m_physicsRef.DisableBody(m_physicsObject.Id);
+}
+
+void Bullet::Spawn(b2Vec2 pos, b2Vec2 dir) {
+    m_physicsRef.EnableBody(m_physicsObject.Id, pos);
     m_physicsObject.ApplyImpulse(
         BULLET_SPEED_COEF * dir.x,
         BULLET_SPEED_COEF * dir.y
     );
+    m_isActive = true;
+    m_hasHit = false;
+    m_age = 0.0f;
+}
+
+void Bullet::Despawn() {
+    m_physicsRef.DisableBody(m_physicsObject.Id);
+    m_isActive = false;
+}
+
+bool Bullet::IsActive() const {
+    return m_isActive;
+}
+
+bool Bullet::Age(float elapsed) {
+    m_age += elapsed;
+    b2Vec2 position = m_physicsRef.GetPosition(m_physicsObject.Id);
+    bool isInBounds =
+        position.x >= g_bulletBounds.lowerBound.x && position.x <= g_bulletBounds.upperBound.x &&
+        position.y >= g_bulletBounds.lowerBound.y && position.y <= g_bulletBounds.upperBound.y;
+    return m_hasHit || m_age > BULLET_LIFETIME || !isInBounds;
+}
+
+float Bullet::GetAge() const {
+    return m_age;
 }
 
 void Bullet::Render() {
-    std::vector<b2Vec2> vertices = m_physicsObject.GetWorldVertices();
-    float width = abs(vertices[0].x - vertices[1].x) * 0.5f;
-    float height = abs(vertices[1].y - vertices[2].y) * 0.5f;
-    RendererTriangle triangle;
-    triangle.points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .texIdx = m_texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[1].x, .y = vertices[1].y, .texIdx = m_texIdx };
-    triangle.points[2] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .texIdx = m_texIdx };
-    triangle.points[0].u = 0; triangle.points[0].v = 1;
-    triangle.points[1].u = 1; triangle.points[1].v = 1;
-    triangle.points[2].u = 1; triangle.points[2].v = 0;
-    Renderer::GetInstance().PushTriangle(triangle);
-    triangle.points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .texIdx = m_texIdx };
-    triangle.points[1] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .texIdx = m_texIdx };
-    triangle.points[2] = RendererVertex{ .x = vertices[3].x, .y = vertices[3].y, .texIdx = m_texIdx };
-    triangle.points[0].u = 0; triangle.points[0].v = 1;
-    triangle.points[1].u = 1; triangle.points[1].v = 0;
-    triangle.points[2].u = 0; triangle.points[2].v = 0;
-    Renderer::GetInstance().PushTriangle(triangle);
+    std::vector<b2Vec2> vertices = m_physicsObject.GetWorldVertices(
+        m_physicsRef.GetRenderTransform(m_physicsObject.Id));
+    std::span<RendererTriangle> triangles = Renderer::GetInstance().ReserveTriangles(2);
+    triangles[0].points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .u = 0, .v = 1, .texIdx = m_texIdx };
+    triangles[0].points[1] = RendererVertex{ .x = vertices[1].x, .y = vertices[1].y, .u = 1, .v = 1, .texIdx = m_texIdx };
+    triangles[0].points[2] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .u = 1, .v = 0, .texIdx = m_texIdx };
+    triangles[1].points[0] = RendererVertex{ .x = vertices[0].x, .y = vertices[0].y, .u = 0, .v = 1, .texIdx = m_texIdx };
+    triangles[1].points[1] = RendererVertex{ .x = vertices[2].x, .y = vertices[2].y, .u = 1, .v = 0, .texIdx = m_texIdx };
+    triangles[1].points[2] = RendererVertex{ .x = vertices[3].x, .y = vertices[3].y, .u = 0, .v = 0, .texIdx = m_texIdx };
+}
+
+void Bullet::OnHit(Entity&) {
+    m_hasHit = true;
+}
+
+BulletPool::BulletPool(Platform& platform, Physics& physics, unsigned int texIdx, size_t capacity) {
+    m_bullets.reserve(capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        m_bullets.push_back(std::make_unique<Bullet>(platform, physics, texIdx));
+    }
+}
+
+void BulletPool::Spawn(b2Vec2 pos, b2Vec2 dir) {
+    Bullet* pBullet = nullptr;
+    for (auto& bullet : m_bullets) {
+        if (!bullet->IsActive()) {
+            pBullet = bullet.get();
+            break;
+        }
+        if (pBullet == nullptr || bullet->GetAge() > pBullet->GetAge())
+            pBullet = bullet.get();
+    }
+    if (pBullet == nullptr)
+        return;
+    pBullet->Spawn(pos, dir);
+}
+
+void BulletPool::Update(float elapsed) {
+    for (auto& bullet : m_bullets) {
+        if (bullet->IsActive() && bullet->Age(elapsed))
+            bullet->Despawn();
+    }
+}
+
+void BulletPool::Render() {
+    for (auto& bullet : m_bullets) {
+        if (bullet->IsActive())
+            bullet->Render();
+    }
+}
+
+HitscanWeapon::HitscanWeapon(Platform& platform, Physics& physics, unsigned int texIdx)
+    : Entity(platform, physics, texIdx)
+{}
+
+void HitscanWeapon::Fire(b2Vec2 pos, b2Vec2 dir) {
+    m_physicsRef.QueueRayCast(pos, b2MulSV(HITSCAN_RANGE, dir), static_cast<Entity*>(this), PHYSICS_CATEGORY_BULLET);
 }
 
 enum TextureIndices {
@@ -164,25 +239,44 @@ enum TextureIndices {
     BULLET_TEX_IDX = 3
 };
 
-EntityFactory::EntityFactory(Platform& platform, Physics& physics) :
+EntityFactory::EntityFactory(Platform& platform, Physics& physics, uint32_t seed) :
     m_platformRef(platform),
     m_physicsRef(physics),
+    m_nextEnemySeed(seed),
     m_playerForce(PLAYER_FORCE),
     m_enemyForce(PLAYER_FORCE),
     m_bulletRadius(BULLET_RADIUS),
     m_bulletSpeedCoef(BULLET_SPEED_COEF)
 {}
 
-Entity* EntityFactory::MakePlayer() {
-    return new Player(m_platformRef, m_physicsRef, PLAYER_TEX_IDX);
+Entity* EntityFactory::MakePlayer(PlayerController controller) {
+    return new Player(m_platformRef, m_physicsRef, PLAYER_TEX_IDX, controller);
 }
 Entity* EntityFactory::MakeEnemy(b2Vec2 pos) {
-    return new Enemy(m_platformRef, m_physicsRef, ENEMY_TEX_IDX, pos);
+    return new Enemy(m_platformRef, m_physicsRef, ENEMY_TEX_IDX, pos, m_nextEnemySeed++);
+}
+std::vector<Entity*> EntityFactory::MakeEnemies(const std::span<const b2Vec2>& positions) {
+    std::vector<PhysicsSoftBody> softBodies = m_physicsRef.CreateSoftBodies(positions, GetSoftbodyTemplate(), PHYSICS_CATEGORY_ENEMY);
+    std::vector<Entity*> enemies;
+    enemies.reserve(softBodies.size());
+    for (auto& softBody : softBodies) {
+        enemies.push_back(new Enemy(m_platformRef, m_physicsRef, ENEMY_TEX_IDX, std::move(softBody), m_nextEnemySeed++));
+    }
+    return enemies;
 }
 Entity* EntityFactory::MakeWall(b2Vec2 pos, b2Vec2 size) {
+    m_levelGeometry.AddBox(pos, size);
     return new Wall(m_platformRef, m_physicsRef, WALL_TEX_IDX, pos, size);
 }
-Entity* EntityFactory::MakeBullet(b2Vec2 pos, b2Vec2 dir) {
-    return new Bullet(m_platformRef, m_physicsRef, BULLET_TEX_IDX, pos + dir * 0.5f, dir);
+Entity* EntityFactory::MakeLevelGeometry() {
+    Entity* pLevelGeometry = new LevelGeometry(m_platformRef, m_physicsRef, WALL_TEX_IDX, m_levelGeometry);
+    m_levelGeometry.Clear();
+    return pLevelGeometry;
+}
+BulletPool EntityFactory::MakeBulletPool(size_t capacity) {
+    return BulletPool(m_platformRef, m_physicsRef, BULLET_TEX_IDX, capacity);
+}
+Entity* EntityFactory::MakeHitscanWeapon() {
+    return new HitscanWeapon(m_platformRef, m_physicsRef, BULLET_TEX_IDX);
 }
 
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <array>
+#include <memory>
+#include <random>
+#include <vector>
+#include "level_geometry.h"
 #include "physics.h"
 #include "renderer.h"
 #include "platform.h"
@@ -9,12 +13,27 @@ constexpr float PLAYER_FORCE      = 0.008f;
 constexpr float ENEMY_FORCE       = 0.0004f;
 constexpr float BULLET_RADIUS     = 0.10f;
 constexpr float BULLET_SPEED_COEF = 1.0f;
+// Seconds before a bullet that hit nothing is despawned
+constexpr float BULLET_LIFETIME   = 3.0f;
+// Length of a hitscan shot
+constexpr float HITSCAN_RANGE     = 15.0f;
+// Bullets leaving this area are despawned
+constexpr b2AABB g_bulletBounds = { .lowerBound = { -1.0f, -2.0f }, .upperBound = { 11.0f, 10.0f } };
+
+enum {
+    ENEMY_HEALTH = 3,
+    // Frames an enemy wanders after spawning or being hit, then it rests so its bodies can fall asleep
+    ENEMY_WANDER_FRAMES = 300,
+    BULLET_POOL_CAPACITY = 64
+};
 
 class Entity {
 public:
     Entity(Platform& platform, Physics& physics, unsigned int texIdx);
     virtual void Render() = 0;
     virtual void Update() = 0;
+    // Called once for each PhysicsHit between this entity and another one
+    virtual void OnHit([[maybe_unused]] Entity& other) {}
 protected:
     Platform &m_platformRef;
     Physics &m_physicsRef;
@@ -40,54 +59,125 @@ constexpr std::array<PhysicsSoftBodyJointConn, 8> g_softbodyConnections = {
     PhysicsSoftBodyJointConn{ 1, 4 },
 };
 
+// Collision of the player with PLAYER_CONTROLLER_MOVER, about the size of the softbody
+constexpr b2Capsule g_playerCapsule = {
+    .center1 = b2Vec2{ 0.0f, -0.07f },
+    .center2 = b2Vec2{ 0.0f, +0.07f },
+    .radius = 0.25f
+};
+
 class Player : public Entity {
 public:
-    Player(Platform& platform, Physics& physics, unsigned int texIdx);
+    Player(Platform& platform, Physics& physics, unsigned int texIdx, PlayerController controller);
     void Render() override;
     void Update() override;
     b2Vec2 GetPosition();
     void ApplyImpulse(float x, float y);
 private:
     PhysicsSoftBody m_physicsObject;
+    PlayerController m_controller;
+    PhysicsMover m_mover = {};
 };
 
+// Only draws the box: its collision is part of the level geometry
 class Wall : public Entity {
 public:
     Wall(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos, b2Vec2 size);
     void Render() override;
     void Update() override {}
 private:
-    PhysicsRigidBox m_physicsObject;
+    std::array<b2Vec2, 4> m_vertices;
+};
+
+// Collision of all the walls, merged into chain loops on a single static body
+class LevelGeometry : public Entity {
+public:
+    LevelGeometry(Platform& platform, Physics& physics, unsigned int texIdx, const LevelGeometryBuilder& builder);
+    void Render() override {}
+    void Update() override {}
+private:
+    PhysicsChainBody m_physicsObject;
 };
 
 class Enemy : public Entity {
 public:
-    Enemy(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos);
+    // seed -> of the enemy's own random wandering, the same seed gives the same moves
+    Enemy(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos, uint32_t seed);
+    // Takes over a softbody that was already created (e.g. by Physics::CreateSoftBodies)
+    Enemy(Platform& platform, Physics& physics, unsigned int texIdx, PhysicsSoftBody&& softBody, uint32_t seed);
     void Render() override;
     void Update() override;
+    void OnHit(Entity& other) override;
 private:
     PhysicsSoftBody m_physicsObject;
+    int m_health = ENEMY_HEALTH;
+    int m_wanderFrames = ENEMY_WANDER_FRAMES;
+    std::mt19937 m_rng;
 };
 
+// Bullets are owned by a BulletPool: their bodies are created once and disabled while not in use
 class Bullet : public Entity {
 public:
-    Bullet(Platform& platform, Physics& physics, unsigned int texIdx, b2Vec2 pos, b2Vec2 dir);
+    Bullet(Platform& platform, Physics& physics, unsigned int texIdx);
     void Render() override;
     void Update() override {};
+    void OnHit(Entity& other) override;
+    void Spawn(b2Vec2 pos, b2Vec2 dir);
+    void Despawn();
+    bool IsActive() const;
+    // elapsed -> seconds since the previous call; returns true if the bullet should be despawned
+    bool Age(float elapsed);
+    float GetAge() const;
 private:
     PhysicsRigidCircle m_physicsObject;
+    bool m_isActive = false;
+    bool m_hasHit = false;
+    float m_age = 0.0f;
+};
+
+class BulletPool {
+public:
+    BulletPool(Platform& platform, Physics& physics, unsigned int texIdx, size_t capacity);
+    // Takes a free bullet, or recycles the oldest one when all of them are in flight
+    void Spawn(b2Vec2 pos, b2Vec2 dir);
+    // Despawns bullets that timed out, left the world or hit something
+    void Update(float elapsed);
+    void Render();
+private:
+    // Bullets are stored as their body user data, so their addresses must not change
+    std::vector<std::unique_ptr<Bullet>> m_bullets;
+};
+
+// Alternative to bullets for high rates of fire: shots have no body and are resolved by batched
+// ray casts (see Physics::CastQueuedRays); the weapon is the user data of the hits they produce
+class HitscanWeapon : public Entity {
+public:
+    HitscanWeapon(Platform& platform, Physics& physics, unsigned int texIdx);
+    void Render() override {}
+    void Update() override {}
+    // Queues a shot of HITSCAN_RANGE from pos along dir (normalized)
+    void Fire(b2Vec2 pos, b2Vec2 dir);
 };
 
 class EntityFactory {
 public:
-    EntityFactory(Platform& platform, Physics& physics);
-    Entity* MakePlayer();
+    // seed -> enemies get consecutive seeds starting from it, in creation order
+    EntityFactory(Platform& platform, Physics& physics, uint32_t seed);
+    Entity* MakePlayer(PlayerController controller = PLAYER_CONTROLLER_SOFTBODY);
     Entity* MakeEnemy(b2Vec2 pos);
+    // Spawns a whole wave of enemies at once
+    std::vector<Entity*> MakeEnemies(const std::span<const b2Vec2>& positions);
+    // The wall's box is added to the level geometry, whose collision is created by MakeLevelGeometry
     Entity* MakeWall(b2Vec2 pos, b2Vec2 size);
-    Entity* MakeBullet(b2Vec2 pos, b2Vec2 dir);
+    // Collision of the walls made since the previous call
+    Entity* MakeLevelGeometry();
+    BulletPool MakeBulletPool(size_t capacity);
+    Entity* MakeHitscanWeapon();
 private:
     Platform& m_platformRef;
     Physics& m_physicsRef;
+    LevelGeometryBuilder m_levelGeometry;
+    uint32_t m_nextEnemySeed;
     float m_playerForce;
     float m_enemyForce;
     float m_bulletRadius;
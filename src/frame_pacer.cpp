@@ -0,0 +1,62 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "SDL3/SDL.h"
+
+FramePacer::FramePacer(float targetRate) {
+    SetTargetRate(targetRate);
+}
+
+void FramePacer::SetTargetRate(float targetRate) {
+    if (targetRate > 0.0f)
+        m_period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetRate));
+    else
+        m_period = Clock::duration::zero();
+    Reset();
+}
+
+void FramePacer::Reset() {
+    m_lastFrame = Clock::now();
+    m_deadline = m_lastFrame + m_period;
+}
+
+void FramePacer::Wait() {
+    const auto spinThreshold = std::chrono::microseconds(FRAME_PACER_SPIN_US);
+
+    auto now = Clock::now();
+    if (now >= m_deadline) {
+        if (m_period != Clock::duration::zero()) {
+            m_stats.missedCount++;
+            double latenessMs = std::chrono::duration<double, std::milli>(now - m_deadline).count();
+            m_stats.maxLatenessMs = std::max(m_stats.maxLatenessMs, latenessMs);
+        }
+        // Don't try to catch up by running late frames back to back
+        m_deadline = now;
+    }
+    else {
+        // Sleep in short slices, the OS may oversleep each of them by a fraction of a millisecond
+        while (m_deadline - now > spinThreshold) {
+            SDL_DelayNS(SDL_NS_PER_MS);
+            now = Clock::now();
+        }
+        while (Clock::now() < m_deadline) {
+            std::this_thread::yield();
+        }
+        now = Clock::now();
+    }
+
+    m_stats.frameCount++;
+    double intervalMs = std::chrono::duration<double, std::milli>(now - m_lastFrame).count();
+    double periodMs = std::chrono::duration<double, std::milli>(m_period).count();
+    m_jitterSumMs += std::abs(intervalMs - periodMs);
+    m_stats.jitterMs = m_jitterSumMs / m_stats.frameCount;
+
+    m_lastFrame = now;
+    m_deadline += m_period;
+}
+
+FramePacerStats FramePacer::GetStats() const {
+    return m_stats;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+
+enum {
+    // How close to the deadline the pacer stops sleeping and starts spinning
+    FRAME_PACER_SPIN_US = 2000
+};
+
+struct FramePacerStats {
+    unsigned long long frameCount;
+    // Frames that were already past their deadline when Wait() was called
+    unsigned long long missedCount;
+    // Mean absolute difference between the measured frame interval and the target one
+    double jitterMs;
+    double maxLatenessMs;
+};
+
+class FramePacer {
+public:
+    // targetRate -> frames per second; 0 disables pacing but still collects stats
+    FramePacer(float targetRate);
+    void SetTargetRate(float targetRate);
+    // Blocks until the deadline of the current frame: coarse sleep, then a short spin
+    void Wait();
+    // Starts a new deadline schedule from now (e.g. after the loop was blocked on input)
+    void Reset();
+    FramePacerStats GetStats() const;
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::duration m_period;
+    Clock::time_point m_deadline;
+    Clock::time_point m_lastFrame;
+    FramePacerStats m_stats = {};
+    double m_jitterSumMs = 0.0;
+};
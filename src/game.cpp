@@ -1,9 +1,15 @@
 #include "game.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
 #include <vector>
 #include "entity.h"
+#include "physics_allocator.h"
+#include "softbody_batch.h"
 
 template<class T>
 class SmartPtr {
@@ -27,7 +33,38 @@ private:
     T* m_pPtr = nullptr;
 };
 
-Game::Game() {
+// Hands every hit to both entities involved
+static void DispatchHits(const std::vector<PhysicsHit>& hits) {
+    for (const PhysicsHit& hit : hits) {
+        Entity* pEntityA = static_cast<Entity*>(hit.pUserDataA);
+        Entity* pEntityB = static_cast<Entity*>(hit.pUserDataB);
+        if (pEntityA == nullptr || pEntityB == nullptr)
+            continue;
+        pEntityA->OnHit(*pEntityB);
+        pEntityB->OnHit(*pEntityA);
+    }
+}
+
+Game::Game()
+    : m_taskSystem(GAME_DETERMINISTIC ? GAME_DETERMINISTIC_WORKER_COUNT : GAME_PHYSICS_WORKER_COUNT),
+      m_physics(PHYSICS_TIMESTEP, &m_taskSystem),
+      m_pacer(GAME_TARGET_FPS)
+{
+    m_physics.SetSoftBodySolver(GAME_SOFTBODY_SOLVER);
+    m_physics.SetActivationConfig(PhysicsActivationConfig{
+        .cellSize = GAME_ACTIVATION_CELL_SIZE,
+        .activateRadius = GAME_ACTIVATE_RADIUS,
+        .deactivateRadius = GAME_DEACTIVATE_RADIUS
+    });
+    if (GAME_DETERMINISTIC) {
+        // The adaptive substep count depends on measured step times
+        m_physics.SetSubstepConfig(PhysicsSubstepConfig{
+            .minCount = GAME_DETERMINISTIC_SUBSTEP_COUNT,
+            .maxCount = GAME_DETERMINISTIC_SUBSTEP_COUNT,
+            .stepBudgetMs = PHYSICS_STEP_BUDGET_MS
+        });
+        m_physics.SetStateTracing(true);
+    }
 }
 
 Game::~Game() {
@@ -44,66 +81,182 @@ void Game::Run() {
         }
     );
 
-    EntityFactory factory(m_platform, m_physics);
+    EntityFactory factory(m_platform, m_physics, GAME_DETERMINISTIC ? GAME_DETERMINISTIC_SEED : std::random_device()());
     std::vector<SmartPtr<Entity>> objects;
     // Player
-    objects.push_back(SmartPtr<Entity>(factory.MakePlayer()));
+    objects.push_back(SmartPtr<Entity>(factory.MakePlayer(GAME_PLAYER_CONTROLLER)));
     Player* pPlayer = dynamic_cast<Player*>(objects[0].GetRawPtr());
     // Walls
     objects.push_back(SmartPtr<Entity>(factory.MakeWall(b2Vec2{5, 7}, b2Vec2(10, 1))));
     objects.push_back(SmartPtr<Entity>(factory.MakeWall(b2Vec2{0, 3}, b2Vec2(1, 7))));
     objects.push_back(SmartPtr<Entity>(factory.MakeWall(b2Vec2{10, 3}, b2Vec2(1, 7))));
     objects.push_back(SmartPtr<Entity>(factory.MakeWall(b2Vec2{5, 3}, b2Vec2(6, 1))));
+    objects.push_back(SmartPtr<Entity>(factory.MakeLevelGeometry()));
     // Enemies
-    objects.push_back(SmartPtr<Entity>(factory.MakeEnemy(b2Vec2{4, 1})));
-    objects.push_back(SmartPtr<Entity>(factory.MakeEnemy(b2Vec2{6, 1})));
-
-    constexpr float physicsTimestep = 1/60.0f;
+    constexpr std::array<b2Vec2, 2> enemyPositions = { b2Vec2{4, 1}, b2Vec2{6, 1} };
+    for (Entity* pEnemy : factory.MakeEnemies(enemyPositions)) {
+        objects.push_back(SmartPtr<Entity>(pEnemy));
+    }
+    // Bullets
+    BulletPool bullets = factory.MakeBulletPool(BULLET_POOL_CAPACITY);
+    objects.push_back(SmartPtr<Entity>(factory.MakeHitscanWeapon()));
+    HitscanWeapon* pHitscan = dynamic_cast<HitscanWeapon*>(objects.back().GetRawPtr());
 
     bool clickIsPressed = true, clickHasBeenReleased = true;
+    std::vector<PhysicsHit> hits;
+
+    // In deterministic mode every frame takes exactly one step after the logic, on this thread
+    if (!GAME_DETERMINISTIC)
+        m_physics.StartThread();
 
     auto then = std::chrono::steady_clock::now();
     while (!m_platform.WindowShouldClose()) {
         auto now = std::chrono::steady_clock::now();
-        float sinceLastStep = std::chrono::duration<float>(now - then).count();
+        float sinceLastFrame = std::chrono::duration<float>(now - then).count();
+        then = now;
 
         // Event handling
-        m_platform.HandleEvents();
-
-        // Object spawning logic
-        float mouseX, mouseY;
-        m_platform.GetMousePosition(&mouseX, &mouseY, &clickIsPressed);
-        int wndWidth, wndHeight;
-        m_platform.GetWindowSize(&wndWidth, &wndHeight);
-        mouseX *= 10.0f / (float)wndWidth;
-        mouseY *= 10.0f / (float)wndWidth;
-        if (clickIsPressed && clickHasBeenReleased == true) {
-            pPlayer->ApplyImpulse(
-                PLAYER_FORCE * -(mouseX - pPlayer->GetPosition().x),
-                PLAYER_FORCE * -(mouseY - pPlayer->GetPosition().y)
-            );
-            b2Vec2 bulletDir = b2MulSV(1.0f, b2Normalize(b2Sub(b2Vec2{ .x = mouseX, .y = mouseY }, pPlayer->GetPosition())));
-            objects.push_back(SmartPtr<Entity>(factory.MakeBullet(pPlayer->GetPosition(), bulletDir)));
-            clickHasBeenReleased = false;
-        }
-        else if (!clickIsPressed) {
-            clickHasBeenReleased = true;
+        bool hadEvents = m_platform.HandleEvents();
+
+        // Latest state published by the physics thread, read by logic and rendering below
+        m_physics.AcquireFrame();
+
+        // Nothing is moving and there was no input: the last frame is still up to date,
+        // so skip rebuilding and resubmitting it and sleep until something happens
+        // the event that ends the wait is consumed by HandleEvents on the next iteration
+        if (!GAME_DETERMINISTIC && !hadEvents && m_physics.IsIdle()) {
+            m_platform.WaitEvents(GAME_IDLE_WAIT_MS);
+            then = std::chrono::steady_clock::now();
+            m_pacer.Reset();
+            continue;
         }
 
-        // Physics
-        if (sinceLastStep > physicsTimestep) {
-            m_physics.Update(sinceLastStep);
-            then = now;
+        // Game logic changes the world, so it runs between two steps of the physics thread
+        {
+            PhysicsWorldLock lock(m_physics);
+
+            // Hits of the steps taken since the previous frame, before a spawn can recycle their bullet
+            m_physics.DrainHits(hits);
+            DispatchHits(hits);
+
+            // Object spawning logic
+            float mouseX, mouseY;
+            m_platform.GetMousePosition(&mouseX, &mouseY, &clickIsPressed);
+            int wndWidth, wndHeight;
+            m_platform.GetWindowSize(&wndWidth, &wndHeight);
+            mouseX *= 10.0f / (float)wndWidth;
+            mouseY *= 10.0f / (float)wndWidth;
+            if (clickIsPressed && clickHasBeenReleased == true) {
+                pPlayer->ApplyImpulse(
+                    PLAYER_FORCE * -(mouseX - pPlayer->GetPosition().x),
+                    PLAYER_FORCE * -(mouseY - pPlayer->GetPosition().y)
+                );
+                b2Vec2 bulletDir = b2MulSV(1.0f, b2Normalize(b2Sub(b2Vec2{ .x = mouseX, .y = mouseY }, pPlayer->GetPosition())));
+                if (GAME_PROJECTILE_MODE == GAME_PROJECTILE_HITSCAN)
+                    pHitscan->Fire(pPlayer->GetPosition() + bulletDir * 0.5f, bulletDir);
+                else
+                    bullets.Spawn(pPlayer->GetPosition() + bulletDir * 0.5f, bulletDir);
+                clickHasBeenReleased = false;
+            }
+            else if (!clickIsPressed) {
+                clickHasBeenReleased = true;
+            }
+
+            // Hits of this frame's hitscan shots
+            m_physics.CastQueuedRays(hits);
+            DispatchHits(hits);
+            bullets.Update(GAME_DETERMINISTIC ? PHYSICS_TIMESTEP : sinceLastFrame);
+
+            for (auto& object : objects) {
+                object->Update();
+            }
+
+            m_physics.UpdateActivation(pPlayer->GetPosition());
         }
+        if (GAME_DETERMINISTIC)
+            m_physics.Update(PHYSICS_TIMESTEP);
 
-        // Update and render
+        // Rendering only reads the acquired frame, the physics thread keeps stepping meanwhile
         for (auto& object : objects) {
-            object->Update();
             object->Render();
         }
+        bullets.Render();
+        SoftbodyBatch::GetInstance().Flush();
 
         Renderer::GetInstance().RenderScene();
+
+        m_pacer.Wait();
     }
+    m_physics.StopThread();
     Renderer::GetInstance().Release();
+
+    if (GAME_PRINT_STATS)
+        PrintStats();
+
+    if (GAME_DETERMINISTIC) {
+        const PhysicsStateTrace& trace = m_physics.GetStateTrace();
+        PhysicsStateTrace reference;
+        // Only the first run records the reference, a corrupt one is reported rather than replaced
+        if (!std::filesystem::exists(GAME_STATE_TRACE_PATH)) {
+            if (trace.Save(GAME_STATE_TRACE_PATH))
+                std::cout << "State trace of " << trace.GetStepCount() << " steps saved to " << GAME_STATE_TRACE_PATH << "\n";
+            else
+                std::cout << "Could not save the state trace to " << GAME_STATE_TRACE_PATH << "\n";
+        }
+        else if (!reference.Load(GAME_STATE_TRACE_PATH)) {
+            std::cout << "Could not read the state trace " << GAME_STATE_TRACE_PATH << ", it is left as is\n";
+        }
+        else if (int64_t step = trace.FindDivergence(reference); step >= 0) {
+            std::cout << "State diverged from " << GAME_STATE_TRACE_PATH << " at step " << step << "\n";
+        }
+        else {
+            std::cout << "State matches " << GAME_STATE_TRACE_PATH << " over "
+                      << std::min(trace.GetStepCount(), reference.GetStepCount()) << " steps\n";
+        }
+    }
 }
 
+void Game::PrintStats() const {
+    FramePacerStats pacerStats = m_pacer.GetStats();
+    std::cout << "Frames: " << pacerStats.frameCount
+              << ", missed deadlines: " << pacerStats.missedCount
+              << ", jitter: " << pacerStats.jitterMs << " ms"
+              << ", worst lateness: " << pacerStats.maxLatenessMs << " ms\n";
+
+    const PhysicsTelemetry& telemetry = m_physics.GetTelemetry();
+    std::cout << "Physics steps (last " << telemetry.GetSampleCount() << "), min/avg/p99 ms:\n";
+    for (int i = 0; i < PHYSICS_TELEMETRY_STAGE_COUNT; i++) {
+        PhysicsTelemetryStage stage = (PhysicsTelemetryStage)i;
+        PhysicsTelemetryStat stat = telemetry.GetStat(stage);
+        std::cout << "  " << PhysicsTelemetry::GetStageName(stage) << ": "
+                  << stat.min << " / " << stat.avg << " / " << stat.p99 << "\n";
+    }
+
+    if (!PhysicsAllocator::GetInstance().IsInstalled()) {
+        std::cout << "box2d memory: not tracked, box2d allocated before PhysicsAllocator was installed\n";
+        return;
+    }
+    PhysicsAllocatorStats allocatorStats = PhysicsAllocator::GetInstance().GetStats();
+    uint64_t stepAllocationCount = 0, maxStepAllocationCount = 0;
+    for (size_t i = 0; i < telemetry.GetSampleCount(); i++) {
+        stepAllocationCount += telemetry.GetSample(i).allocationCount;
+        maxStepAllocationCount = std::max(maxStepAllocationCount, telemetry.GetSample(i).allocationCount);
+    }
+    std::cout << "box2d memory: " << allocatorStats.bytesInUse << " bytes in use"
+              << ", peak " << allocatorStats.peakBytesInUse
+              << ", reserved " << allocatorStats.reservedBytes
+              << ", " << allocatorStats.allocationCount << " allocations ("
+              << allocatorStats.systemAllocationCount << " from the system)"
+              << ", per step avg/max " << (telemetry.GetSampleCount() > 0 ? (float)stepAllocationCount / telemetry.GetSampleCount() : 0.0f)
+              << " / " << maxStepAllocationCount << "\n";
+    for (int i = 0; i <= PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT; i++) {
+        if (allocatorStats.allocationsBySizeClass[i] == 0)
+            continue;
+        if (i < PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT)
+            std::cout << "  <= " << PhysicsAllocator::GetSizeClassBytes(i) << " bytes: ";
+        else
+            std::cout << "  larger: ";
+        std::cout << allocatorStats.allocationsBySizeClass[i] << " allocations, "
+                  << allocatorStats.bytesBySizeClass[i] << " bytes in use\n";
+    }
+}
@@ -1,23 +1,67 @@
 #pragma once
+#include <cstdint>
 #include <span>
 #include "box2d/box2d.h"
 
 #include "platform.h"
 #include "renderer.h"
 #include "physics.h"
+#include "frame_pacer.h"
+#include "task_system.h"
 
 enum {
     GAME_WND_W = 1024,
-    GAME_WND_H = 768
+    GAME_WND_H = 768,
+    // Upper bound on how long an idle frame blocks waiting for input
+    GAME_IDLE_WAIT_MS = 100,
+    GAME_TARGET_FPS = 60,
+    // Threads stepping the physics world, 0 -> one per hardware thread
+    GAME_PHYSICS_WORKER_COUNT = 0,
+    // Used instead of the above in deterministic mode, the same on every machine
+    GAME_DETERMINISTIC_WORKER_COUNT = 4,
+    GAME_DETERMINISTIC_SUBSTEP_COUNT = 4
 };
 
+// Bit-identical runs for replays and lockstep: fixed worker and substep counts, exactly one physics step
+// per frame on the game thread, seeded enemies, and the state hash of every step recorded; the first run
+// saves the trace to GAME_STATE_TRACE_PATH, later runs report the first step that differs from it
+constexpr bool GAME_DETERMINISTIC = false;
+constexpr uint32_t GAME_DETERMINISTIC_SEED = 1;
+constexpr const char* GAME_STATE_TRACE_PATH = "state_trace.txt";
+
+enum GameProjectileMode {
+    // Pooled bullet bodies simulated by box2d
+    GAME_PROJECTILE_BULLETS,
+    // Instant shots resolved with batched ray casts
+    GAME_PROJECTILE_HITSCAN
+};
+
+constexpr GameProjectileMode GAME_PROJECTILE_MODE = GAME_PROJECTILE_BULLETS;
+
+// Bodies beyond GAME_DEACTIVATE_RADIUS of the player are disabled until they are back within GAME_ACTIVATE_RADIUS
+constexpr float GAME_ACTIVATION_CELL_SIZE = 4.0f;
+constexpr float GAME_ACTIVATE_RADIUS      = 12.0f;
+constexpr float GAME_DEACTIVATE_RADIUS    = 16.0f;
+
+// PLAYER_CONTROLLER_MOVER moves the player as a kinematic capsule, its softbody only follows as visuals
+constexpr PlayerController GAME_PLAYER_CONTROLLER = PLAYER_CONTROLLER_SOFTBODY;
+
+// PHYSICS_SOFTBODY_SOLVER_XPBD trades the 8 distance joints of every softbody for the batched XPBD solver
+constexpr PhysicsSoftBodySolver GAME_SOFTBODY_SOLVER = PHYSICS_SOFTBODY_SOLVER_JOINTS;
+
+// Prints the frame pacing and physics stats of the session on exit
+constexpr bool GAME_PRINT_STATS = false;
+
 class Game {
 public:
     Game();
     ~Game();
     void Run();
 private:
+    void PrintStats() const;
     Platform m_platform;
+    TaskSystem m_taskSystem;
     Physics m_physics;
+    FramePacer m_pacer;
 };
 
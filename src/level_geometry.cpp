@@ -0,0 +1,125 @@
+#include "level_geometry.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// Sorted box edge coordinates, values closer than LEVEL_GEOMETRY_SNAP merged
+static std::vector<float> GetGridLines(std::vector<float> values) {
+    std::sort(values.begin(), values.end());
+    std::vector<float> lines;
+    for (float value : values) {
+        if (lines.empty() || value - lines.back() > LEVEL_GEOMETRY_SNAP)
+            lines.push_back(value);
+    }
+    return lines;
+}
+
+static int FindGridLine(const std::vector<float>& lines, float value) {
+    auto it = std::lower_bound(lines.begin(), lines.end(), value - LEVEL_GEOMETRY_SNAP);
+    return (int)(it - lines.begin());
+}
+
+void LevelGeometryBuilder::AddBox(b2Vec2 center, b2Vec2 size) {
+    b2Vec2 halfSize = b2MulSV(0.5f, size);
+    m_boxes.push_back(b2AABB{ .lowerBound = b2Sub(center, halfSize), .upperBound = b2Add(center, halfSize) });
+}
+
+bool LevelGeometryBuilder::IsEmpty() const {
+    return m_boxes.empty();
+}
+
+void LevelGeometryBuilder::Clear() {
+    m_boxes.clear();
+}
+
+std::vector<std::vector<b2Vec2>> LevelGeometryBuilder::BuildOutlines() const {
+    // Compressed grid: every box covers a whole number of cells between its edge coordinates
+    std::vector<float> xValues, yValues;
+    for (const b2AABB& box : m_boxes) {
+        xValues.push_back(box.lowerBound.x);
+        xValues.push_back(box.upperBound.x);
+        yValues.push_back(box.lowerBound.y);
+        yValues.push_back(box.upperBound.y);
+    }
+    std::vector<float> xs = GetGridLines(std::move(xValues));
+    std::vector<float> ys = GetGridLines(std::move(yValues));
+    if (xs.size() < 2 || ys.size() < 2)
+        return {};
+
+    int width = (int)xs.size() - 1, height = (int)ys.size() - 1;
+    std::vector<uint8_t> solid(width * height, 0);
+    for (const b2AABB& box : m_boxes) {
+        int x0 = FindGridLine(xs, box.lowerBound.x), x1 = FindGridLine(xs, box.upperBound.x);
+        int y0 = FindGridLine(ys, box.lowerBound.y), y1 = FindGridLine(ys, box.upperBound.y);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                solid[y * width + x] = 1;
+            }
+        }
+    }
+    auto isSolid = [&](int x, int y) {
+        return x >= 0 && y >= 0 && x < width && y < height && solid[y * width + x];
+    };
+
+    // Boundary edges between grid points, solid on their left: following them walks the union
+    // counter-clockwise; grid point (x, y) is x + y * (width + 1)
+    struct Edge {
+        int from;
+        int to;
+    };
+    std::vector<Edge> edges;
+    const int pitch = width + 1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!isSolid(x, y))
+                continue;
+            int p00 = x + y * pitch, p10 = p00 + 1, p01 = p00 + pitch, p11 = p01 + 1;
+            if (!isSolid(x, y - 1)) edges.push_back(Edge{ p00, p10 });
+            if (!isSolid(x + 1, y)) edges.push_back(Edge{ p10, p11 });
+            if (!isSolid(x, y + 1)) edges.push_back(Edge{ p11, p01 });
+            if (!isSolid(x - 1, y)) edges.push_back(Edge{ p01, p00 });
+        }
+    }
+
+    // Two edges leave a point only where solid cells touch diagonally, either choice gives valid loops
+    std::unordered_multimap<int, size_t> edgesFrom;
+    for (size_t i = 0; i < edges.size(); i++) {
+        edgesFrom.emplace(edges[i].from, i);
+    }
+    std::vector<uint8_t> used(edges.size(), 0);
+    auto toPoint = [&](int gridPoint) {
+        return b2Vec2{ xs[gridPoint % pitch], ys[gridPoint / pitch] };
+    };
+
+    std::vector<std::vector<b2Vec2>> outlines;
+    for (size_t first = 0; first < edges.size(); first++) {
+        if (used[first])
+            continue;
+        std::vector<int> loop;
+        size_t current = first;
+        while (!used[current]) {
+            used[current] = 1;
+            loop.push_back(edges[current].from);
+            auto range = edgesFrom.equal_range(edges[current].to);
+            for (auto it = range.first; it != range.second; it++) {
+                if (!used[it->second]) {
+                    current = it->second;
+                    break;
+                }
+            }
+        }
+
+        // Keep only the corners
+        std::vector<b2Vec2> outline;
+        for (size_t i = 0; i < loop.size(); i++) {
+            b2Vec2 prev = toPoint(loop[(i + loop.size() - 1) % loop.size()]);
+            b2Vec2 point = toPoint(loop[i]);
+            b2Vec2 next = toPoint(loop[(i + 1) % loop.size()]);
+            if (b2Cross(b2Sub(point, prev), b2Sub(next, point)) != 0.0f)
+                outline.push_back(point);
+        }
+        if (outline.size() >= 4)
+            outlines.push_back(std::move(outline));
+    }
+    return outlines;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include "box2d/box2d.h"
+
+// Boxes closer than this are treated as touching
+constexpr float LEVEL_GEOMETRY_SNAP = 1e-4f;
+
+// Turns overlapping or touching axis-aligned wall boxes into the outlines of their union,
+// so a whole level collides as a few chain loops instead of one body per tile
+class LevelGeometryBuilder {
+public:
+    void AddBox(b2Vec2 center, b2Vec2 size);
+    bool IsEmpty() const;
+    void Clear();
+    // Closed loops, counter-clockwise around solid areas (clockwise around holes) as chains expect,
+    // collinear points merged; the last point connects back to the first
+    std::vector<std::vector<b2Vec2>> BuildOutlines() const;
+private:
+    std::vector<b2AABB> m_boxes;
+};
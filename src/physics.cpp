@@ -1,7 +1,15 @@
 #include "physics.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <vector>
 #include "box2d/box2d.h"
+#include "frame_pacer.h"
+#include "physics_allocator.h"
+#include "task_system.h"
+#include "xpbd_solver.h"
 
 b2Vec2 operator+(const b2Vec2& left, const b2Vec2& right) {
     return b2Vec2{
@@ -11,30 +19,54 @@ b2Vec2 operator+(const b2Vec2& left, const b2Vec2& right) {
 }
 
 std::vector<b2Vec2> PhysicsRigidBox::GetWorldVertices() const {
+    return GetWorldVertices(b2Body_GetTransform(Id));
+}
+
+std::vector<b2Vec2> PhysicsRigidBox::GetWorldVertices(b2Transform transform) const {
     std::vector<b2Vec2> vertices(polygon.count);
     for (int i = 0; i < polygon.count; i++) {
-        vertices[i] = b2TransformPoint(b2Body_GetTransform(Id), polygon.vertices[i]);
+        vertices[i] = b2TransformPoint(transform, polygon.vertices[i]);
     }
     return vertices;
 }
 
+void PhysicsRigidBox::SetUserData(void* pUserData) {
+    b2Body_SetUserData(Id, pUserData);
+}
+
+void PhysicsChainBody::SetUserData(void* pUserData) {
+    b2Body_SetUserData(Id, pUserData);
+}
+
+void PhysicsMover::SetUserData(void* pUserData) {
+    b2Body_SetUserData(Id, pUserData);
+}
+
 float PhysicsRigidCircle::GetRadius() const {
     return circle.radius;
 }
 
+float PhysicsRigidCircle::GetMass() const {
+    return b2Body_GetMass(Id);
+}
+
 b2Vec2 PhysicsRigidCircle::GetPosition() const {
     return b2Body_GetPosition(Id);
 }
 
 std::vector<b2Vec2> PhysicsRigidCircle::GetWorldVertices() const {
+    return GetWorldVertices(b2Body_GetTransform(Id));
+}
+
+std::vector<b2Vec2> PhysicsRigidCircle::GetWorldVertices(b2Transform transform) const {
     std::vector<b2Vec2> vertices = {
         b2Vec2{ .x = -GetRadius(), .y = -GetRadius() },
         b2Vec2{ .x = +GetRadius(), .y = -GetRadius() },
         b2Vec2{ .x = +GetRadius(), .y = +GetRadius() },
         b2Vec2{ .x = -GetRadius(), .y = +GetRadius() },
     };
-    for (int i = 0; i < vertices.size(); i++) {
-        vertices[i] = b2TransformPoint(b2Body_GetTransform(Id), vertices[i]);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        vertices[i] = b2TransformPoint(transform, vertices[i]);
     }
     return vertices;
 }
@@ -43,78 +75,1266 @@ void PhysicsRigidCircle::ApplyImpulse(float impulseX, float impulseY) {
     b2Body_ApplyLinearImpulseToCenter(Id, b2Vec2{impulseX, impulseY}, true);
 }
 
+void PhysicsRigidCircle::SetUserData(void* pUserData) {
+    b2Body_SetUserData(Id, pUserData);
+}
+
 void PhysicsSoftBody::ApplyImpulse(float impulseX, float impulseY) {
     for (const auto& v : vertices) {
         b2Body_ApplyLinearImpulseToCenter(v.Id, b2Vec2{impulseX, impulseY}, true);
     }
 }
 
-Physics::Physics() {
+void PhysicsSoftBody::SetUserData(void* pUserData) {
+    for (auto& v : vertices) {
+        v.SetUserData(pUserData);
+    }
+}
+
+// Categories each category collides with
+static uint64_t GetCategoryMask(PhysicsCategory category) {
+    switch (category) {
+    case PHYSICS_CATEGORY_PLAYER:
+        return PHYSICS_CATEGORY_WALL | PHYSICS_CATEGORY_PLAYER | PHYSICS_CATEGORY_ENEMY;
+    case PHYSICS_CATEGORY_ENEMY:
+        return PHYSICS_CATEGORY_WALL | PHYSICS_CATEGORY_PLAYER | PHYSICS_CATEGORY_ENEMY | PHYSICS_CATEGORY_BULLET;
+    // Bullets are fired from next to the player and only matter when they hit an enemy or a wall
+    case PHYSICS_CATEGORY_BULLET:
+        return PHYSICS_CATEGORY_WALL | PHYSICS_CATEGORY_ENEMY;
+    default:
+        return PHYSICS_CATEGORY_WALL | PHYSICS_CATEGORY_PLAYER | PHYSICS_CATEGORY_ENEMY | PHYSICS_CATEGORY_BULLET;
+    }
+}
+
+static b2Filter MakeFilter(PhysicsCategory category, int groupIndex = 0) {
+    return b2Filter{
+        .categoryBits = category,
+        .maskBits = GetCategoryMask(category),
+        .groupIndex = groupIndex
+    };
+}
+
+static void* EnqueueTask(b2TaskCallback* pTask, int itemCount, int minRange, void* pTaskContext, void* pUserContext) {
+    return static_cast<TaskSystem*>(pUserContext)->Submit(pTask, itemCount, minRange, pTaskContext);
+}
+
+static void FinishTask(void* pUserTask, void* pUserContext) {
+    static_cast<TaskSystem*>(pUserContext)->Wait(static_cast<Task*>(pUserTask));
+}
+
+Physics::Physics(float timestep, TaskSystem* pTaskSystem)
+    : m_pTaskSystem(pTaskSystem), m_timestep(timestep)
+{
+    // Before the first world allocates anything, box2d keeps its own allocator if it is too late
+    m_countsAllocations = PhysicsAllocator::GetInstance().Install();
     b2WorldDef worldDef = b2DefaultWorldDef();
     worldDef.gravity = b2Vec2{ 0.0f, 9.81f };
+    if (pTaskSystem != nullptr) {
+        worldDef.workerCount = pTaskSystem->GetWorkerCount();
+        worldDef.enqueueTask = EnqueueTask;
+        worldDef.finishTask = FinishTask;
+        worldDef.userTaskContext = pTaskSystem;
+    }
     m_worldId = b2CreateWorld(&worldDef);
+    m_pXpbdSolver = std::make_unique<XpbdSolver>();
+}
+
+Physics::~Physics() {
+    StopThread();
+}
+
+PhysicsWorldLock::PhysicsWorldLock(Physics& physics)
+    : m_physicsRef(physics), m_lock(physics.m_worldMutex)
+{}
+
+PhysicsWorldLock::~PhysicsWorldLock() {
+    // Without this, new bodies would only show up after the next step and read out of range until then
+    if (m_physicsRef.m_framePending && m_physicsRef.m_thread.joinable())
+        m_physicsRef.PublishFrame();
+}
+
+int Physics::Update(float elapsed) {
+    m_accumulator += elapsed;
+    int stepCount = 0;
+    while (m_accumulator >= m_timestep && stepCount < PHYSICS_MAX_CATCHUP_STEPS) {
+        Step();
+        m_accumulator -= m_timestep;
+        stepCount++;
+    }
+    // Too far behind: drop the time that could not be simulated instead of spiraling
+    if (m_accumulator >= m_timestep) {
+        m_accumulator = std::fmod(m_accumulator, m_timestep);
+    }
+    if (stepCount > 0)
+        PublishFrame();
+    return stepCount;
+}
+
+void Physics::StartThread() {
+    if (m_thread.joinable())
+        return;
+    PublishFrame();
+    m_threadStop = false;
+    m_thread = std::thread(&Physics::ThreadMain, this);
+}
+
+void Physics::StopThread() {
+    if (!m_thread.joinable())
+        return;
+    m_threadStop = true;
+    m_thread.join();
+}
+
+void Physics::ThreadMain() {
+    FramePacer pacer(1.0f / m_timestep);
+    while (!m_threadStop.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(m_worldMutex);
+            Step();
+            PublishFrame();
+        }
+        pacer.Wait();
+    }
+}
+
+void Physics::PublishFrame() {
+    uint64_t serial = ++m_publishSerial;
+    std::vector<uint32_t>& changes = m_publishedChanges[serial % PHYSICS_FRAME_HISTORY];
+    changes.clear();
+    std::swap(changes, m_changedIndices);
+
+    PhysicsFrame& frame = m_frames.GetWriteBuffer();
+    bool canPatch =
+        frame.serial != 0 && serial - frame.serial <= PHYSICS_FRAME_HISTORY &&
+        frame.currTransforms.size() == m_currTransforms.size();
+    if (canPatch) {
+        // Mostly sleeping scenes only copy the few bodies that moved since the frame was last filled
+        for (uint64_t s = frame.serial + 1; s <= serial; s++) {
+            for (uint32_t index : m_publishedChanges[s % PHYSICS_FRAME_HISTORY]) {
+                frame.prevTransforms[index] = m_prevTransforms[index];
+                frame.currTransforms[index] = m_currTransforms[index];
+            }
+        }
+    }
+    else {
+        frame.prevTransforms.assign(m_prevTransforms.begin(), m_prevTransforms.end());
+        frame.currTransforms.assign(m_currTransforms.begin(), m_currTransforms.end());
+    }
+    frame.serial = serial;
+    frame.stepTime = std::chrono::steady_clock::now();
+    frame.awakeBodyCount = b2World_GetAwakeBodyCount(m_worldId);
+    m_frames.Publish();
+    m_framePending = false;
+}
+
+void Physics::AcquireFrame() {
+    if (m_thread.joinable()) {
+        m_pFrame = &m_frames.Acquire();
+        // The frame runs one step behind the simulation: it moves from the previous to the last
+        // step during the time the thread takes to produce the next one
+        float sinceStep = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_pFrame->stepTime).count();
+        m_frameAlpha = std::clamp(sinceStep / m_timestep, 0.0f, 1.0f);
+    }
+    else {
+        if (m_framePending || m_pFrame == nullptr)
+            PublishFrame();
+        m_pFrame = &m_frames.Acquire();
+        m_frameAlpha = m_accumulator / m_timestep;
+    }
+}
+
+float Physics::GetAlpha() const {
+    return m_frameAlpha;
+}
+
+b2Transform Physics::GetRenderTransform(b2BodyId bodyId) const {
+    if (m_pFrame == nullptr || (size_t)bodyId.index1 >= m_pFrame->currTransforms.size())
+        return b2Transform_identity;
+    const b2Transform& prev = m_pFrame->prevTransforms[bodyId.index1];
+    const b2Transform& curr = m_pFrame->currTransforms[bodyId.index1];
+    return b2Transform{
+        .p = b2Lerp(prev.p, curr.p, m_frameAlpha),
+        .q = b2NLerp(prev.q, curr.q, m_frameAlpha)
+    };
+}
+
+b2Vec2 Physics::GetRenderPosition(b2BodyId bodyId) const {
+    if (m_pFrame == nullptr || (size_t)bodyId.index1 >= m_pFrame->currTransforms.size())
+        return b2Vec2_zero;
+    return b2Lerp(m_pFrame->prevTransforms[bodyId.index1].p, m_pFrame->currTransforms[bodyId.index1].p, m_frameAlpha);
+}
+
+b2Vec2 Physics::GetPosition(b2BodyId bodyId) const {
+    if (m_pFrame == nullptr || (size_t)bodyId.index1 >= m_pFrame->currTransforms.size())
+        return b2Vec2_zero;
+    return m_pFrame->currTransforms[bodyId.index1].p;
+}
+
+void Physics::Step() {
+    PhysicsAllocator& allocator = PhysicsAllocator::GetInstance();
+    uint64_t allocationCount = m_countsAllocations ? allocator.GetAllocationCount() : 0;
+    for (Mover& mover : m_movers) {
+        SolveMover(mover);
+    }
+    m_pXpbdSolver->BeginStep();
+    b2World_Step(m_worldId, m_timestep, m_substepCount);
+    m_pXpbdSolver->EndStep(m_timestep);
+    SyncMovedTransforms();
+    GatherHits();
+
+    b2Profile profile = b2World_GetProfile(m_worldId);
+    b2Counters counters = b2World_GetCounters(m_worldId);
+    allocationCount = m_countsAllocations ? allocator.GetAllocationCount() - allocationCount : 0;
+    m_telemetry.Record(m_substepCount, profile, counters, allocationCount);
+    AdaptSubstepCount(profile, counters);
+    if (m_stateTracing)
+        m_stateTrace.Record(ComputeStateHash());
+}
+
+struct PhysicsMoverPlanes {
+    b2CollisionPlane planes[PHYSICS_MOVER_PLANE_CAPACITY];
+    int count;
+};
+
+static bool CollectMoverPlane(b2ShapeId shapeId, const b2PlaneResult* pPlaneResult, void* pContext) {
+    PhysicsMoverPlanes& planes = *static_cast<PhysicsMoverPlanes*>(pContext);
+    if (!pPlaneResult->hit || planes.count == PHYSICS_MOVER_PLANE_CAPACITY)
+        return true;
+    // Walls stop the mover, bodies that move only push it back a little and don't stop its velocity
+    bool isStatic = b2Body_GetType(b2Shape_GetBody(shapeId)) == b2_staticBody;
+    planes.planes[planes.count++] = b2CollisionPlane{
+        .plane = pPlaneResult->plane,
+        .pushLimit = isStatic ? FLT_MAX : PHYSICS_MOVER_DYNAMIC_PUSH_LIMIT,
+        .push = 0.0f,
+        .clipVelocity = isStatic
+    };
+    return true;
+}
+
+void Physics::SolveMover(Mover& mover) {
+    // Friction only acts along the ground, so jumping off it isn't slowed down
+    if (mover.isGrounded) {
+        b2Vec2 tangent = b2LeftPerp(mover.groundNormal);
+        float speed = b2Dot(mover.velocity, tangent);
+        float newSpeed = 0.0f;
+        if (std::abs(speed) >= PHYSICS_MOVER_MIN_SPEED) {
+            float drop = std::max(std::abs(speed), PHYSICS_MOVER_STOP_SPEED) * PHYSICS_MOVER_FRICTION * m_timestep;
+            newSpeed = std::copysign(std::max(std::abs(speed) - drop, 0.0f), speed);
+        }
+        mover.velocity = b2MulAdd(mover.velocity, newSpeed - speed, tangent);
+    }
+
+    // The mover isn't simulated, so it takes gravity itself
+    b2Vec2 gravity = b2World_GetGravity(m_worldId);
+    mover.velocity = b2MulAdd(mover.velocity, m_timestep, gravity);
+
+    // Its own body and visual softbody are left out by excluding its category
+    uint64_t maskBits = GetCategoryMask(mover.category) & ~(uint64_t)mover.category;
+    b2QueryFilter collideFilter = { .categoryBits = mover.category, .maskBits = maskBits };
+    // Only walls block the sweep, dynamic bodies are handled by their soft planes
+    b2QueryFilter castFilter = { .categoryBits = mover.category, .maskBits = maskBits & PHYSICS_CATEGORY_WALL };
+
+    b2Vec2 start = b2Body_GetPosition(mover.bodyId);
+    b2Vec2 position = start;
+    b2Vec2 target = b2MulAdd(start, m_timestep, mover.velocity);
+    PhysicsMoverPlanes planes = {};
+    for (int i = 0; i < PHYSICS_MOVER_ITERATION_COUNT; i++) {
+        planes.count = 0;
+        b2Capsule capsule = {
+            .center1 = b2Add(position, mover.capsule.center1),
+            .center2 = b2Add(position, mover.capsule.center2),
+            .radius = mover.capsule.radius
+        };
+        b2World_CollideMover(m_worldId, &capsule, collideFilter, CollectMoverPlane, &planes);
+        b2PlaneSolverResult result = b2SolvePlanes(target, planes.planes, planes.count);
+        b2Vec2 translation = b2Sub(result.position, position);
+        float fraction = b2World_CastMover(m_worldId, &capsule, translation, castFilter);
+        b2Vec2 delta = b2MulSV(fraction, translation);
+        position = b2Add(position, delta);
+        if (b2LengthSquared(delta) < PHYSICS_MOVER_TOLERANCE * PHYSICS_MOVER_TOLERANCE)
+            break;
+    }
+    // Moving into a wall or the floor stops there instead of building up
+    mover.velocity = b2ClipVector(mover.velocity, planes.planes, planes.count);
+    b2Vec2 up = b2Neg(b2Normalize(gravity));
+    mover.isGrounded = false;
+    for (int i = 0; i < planes.count; i++) {
+        const b2CollisionPlane& plane = planes.planes[i];
+        if (plane.clipVelocity && b2Dot(plane.plane.normal, up) >= PHYSICS_MOVER_GROUND_COS) {
+            mover.isGrounded = true;
+            mover.groundNormal = plane.plane.normal;
+            break;
+        }
+    }
+
+    // The kinematic body travels exactly to the solved position during the step, pushing what is in the way
+    b2Vec2 bodyVelocity = b2MulSV(1.0f / m_timestep, b2Sub(position, start));
+    b2Body_SetLinearVelocity(mover.bodyId, bodyVelocity);
+    for (size_t i = 0; i < mover.followers.size(); i++) {
+        b2Vec2 restPosition = b2Add(position, mover.followerOffsets[i]);
+        b2Vec2 gap = b2Sub(restPosition, b2Body_GetPosition(mover.followers[i]));
+        b2Body_SetLinearVelocity(mover.followers[i], b2MulAdd(bodyVelocity, PHYSICS_MOVER_FOLLOW_RATE, gap));
+    }
+}
+
+void Physics::SyncMovedTransforms() {
+    // Bodies at rest keep prev == curr, so only the ones that moved last time need catching up
+    for (b2BodyId bodyId : m_movedBodies) {
+        m_prevTransforms[bodyId.index1] = m_currTransforms[bodyId.index1];
+        m_changedIndices.push_back(bodyId.index1);
+    }
+    m_movedBodies.clear();
+
+    b2BodyEvents events = b2World_GetBodyEvents(m_worldId);
+    for (int i = 0; i < events.moveCount; i++) {
+        const b2BodyMoveEvent& event = events.moveEvents[i];
+        if ((size_t)event.bodyId.index1 >= m_currTransforms.size())
+            continue;
+        m_currTransforms[event.bodyId.index1] = event.transform;
+        m_movedBodies.push_back(event.bodyId);
+        m_changedIndices.push_back(event.bodyId.index1);
+    }
+
+    // The XPBD solver moves its vertices after box2d reported them
+    size_t firstSolverBody = m_movedBodies.size();
+    m_pXpbdSolver->GetMovedBodies(m_movedBodies);
+    for (size_t i = firstSolverBody; i < m_movedBodies.size(); i++) {
+        b2BodyId bodyId = m_movedBodies[i];
+        m_currTransforms[bodyId.index1] = b2Body_GetTransform(bodyId);
+        m_changedIndices.push_back(bodyId.index1);
+    }
+}
+
+void Physics::SetTransformCache(b2BodyId bodyId, b2Transform transform) {
+    m_prevTransforms[bodyId.index1] = transform;
+    m_currTransforms[bodyId.index1] = transform;
+    m_changedIndices.push_back(bodyId.index1);
+    m_framePending = true;
+}
+
+void Physics::GatherHits() {
+    b2ContactEvents events = b2World_GetContactEvents(m_worldId);
+    for (int i = 0; i < events.beginCount; i++) {
+        const b2ContactBeginTouchEvent& event = events.beginEvents[i];
+        if (!b2Shape_IsValid(event.shapeIdA) || !b2Shape_IsValid(event.shapeIdB))
+            continue;
+        const b2Manifold& manifold = event.manifold;
+        m_hits.push_back(PhysicsHit{
+            .pUserDataA = b2Body_GetUserData(b2Shape_GetBody(event.shapeIdA)),
+            .pUserDataB = b2Body_GetUserData(b2Shape_GetBody(event.shapeIdB)),
+            .point = (manifold.pointCount > 0 ? manifold.points[0].point : b2Body_GetPosition(b2Shape_GetBody(event.shapeIdA))),
+            .normal = manifold.normal
+        });
+    }
+}
+
+void Physics::AdaptSubstepCount(const b2Profile& profile, const b2Counters& counters) {
+    // Stiff piles of joints and contacts need more substeps to stay stable
+    int constraintCount = counters.jointCount + counters.contactCount;
+    float stress = std::min(1.0f, constraintCount / (float)PHYSICS_STRESS_CONSTRAINT_COUNT);
+    int target = m_substepConfig.minCount +
+        (int)std::round(stress * (m_substepConfig.maxCount - m_substepConfig.minCount));
+
+    // Only the constraint solver scales with the substep count, the rest of the step is fixed
+    float substepMs = profile.solveConstraints / m_substepCount;
+    if (substepMs > 0.0f) {
+        float fixedMs = profile.step - profile.solveConstraints;
+        int affordable = (int)((m_substepConfig.stepBudgetMs - fixedMs) / substepMs);
+        target = std::min(target, affordable);
+    }
+    target = std::clamp(target, m_substepConfig.minCount, m_substepConfig.maxCount);
+
+    // Shed load right away but add substeps back one at a time, so the count doesn't oscillate
+    if (target < m_substepCount)
+        m_substepCount = target;
+    else if (target > m_substepCount)
+        m_substepCount++;
+}
+
+void Physics::RegisterBody(b2BodyId bodyId) {
+    m_bodies.push_back(bodyId);
+    if (m_currTransforms.size() <= (size_t)bodyId.index1) {
+        m_prevTransforms.resize(bodyId.index1 + 1);
+        m_currTransforms.resize(bodyId.index1 + 1);
+    }
+    // A new body has no motion to interpolate yet
+    SetTransformCache(bodyId, b2Body_GetTransform(bodyId));
+}
+
+bool Physics::IsIdle() const {
+    return m_pFrame != nullptr && m_pFrame->awakeBodyCount == 0;
+}
+
+b2Profile Physics::GetProfile() const {
+    return b2World_GetProfile(m_worldId);
+}
+
+const PhysicsTelemetry& Physics::GetTelemetry() const {
+    return m_telemetry;
+}
+
+void Physics::SetSubstepConfig(const PhysicsSubstepConfig& config) {
+    m_substepConfig = config;
+    m_substepCount = std::clamp(m_substepCount, config.minCount, config.maxCount);
+}
+
+int Physics::GetSubstepCount() const {
+    return m_substepCount;
+}
+
+void Physics::SetSoftBodySolver(PhysicsSoftBodySolver solver) {
+    m_softBodySolver = solver;
+}
+
+uint64_t Physics::ComputeStateHash() const {
+    PhysicsStateHasher hasher;
+    for (b2BodyId bodyId : m_bodies) {
+        b2Transform transform = b2Body_GetTransform(bodyId);
+        b2Vec2 velocity = b2Body_GetLinearVelocity(bodyId);
+        hasher.Add(transform.p.x);
+        hasher.Add(transform.p.y);
+        hasher.Add(transform.q.c);
+        hasher.Add(transform.q.s);
+        hasher.Add(velocity.x);
+        hasher.Add(velocity.y);
+        hasher.Add(b2Body_GetAngularVelocity(bodyId));
+    }
+    // Movers carry velocity of their own, their bodies only show the last step's motion
+    for (const Mover& mover : m_movers) {
+        hasher.Add(mover.velocity.x);
+        hasher.Add(mover.velocity.y);
+        hasher.Add((uint64_t)mover.isGrounded);
+    }
+    return hasher.Finish();
+}
+
+void Physics::SetStateTracing(bool enabled) {
+    m_stateTracing = enabled;
+}
+
+const PhysicsStateTrace& Physics::GetStateTrace() const {
+    return m_stateTrace;
+}
+
+void Physics::SetActivationConfig(const PhysicsActivationConfig& config) {
+    while (!m_parkedCells.empty()) {
+        std::vector<uint32_t> groups = std::move(m_parkedCells.begin()->second);
+        m_parkedCells.erase(m_parkedCells.begin());
+        for (uint32_t groupIndex : groups) {
+            SetGroupParked(groupIndex, false);
+            m_activeGroups.push_back(groupIndex);
+        }
+    }
+    m_activationConfig = config;
+}
+
+// Distance from point to the closest point of the cell
+static float GetCellDistance(int32_t cellX, int32_t cellY, float cellSize, b2Vec2 point) {
+    float dx = std::max({ cellX * cellSize - point.x, 0.0f, point.x - (cellX + 1) * cellSize });
+    float dy = std::max({ cellY * cellSize - point.y, 0.0f, point.y - (cellY + 1) * cellSize });
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+uint64_t Physics::GetCellKey(b2Vec2 position) const {
+    int32_t cellX = (int32_t)std::floor(position.x / m_activationConfig.cellSize);
+    int32_t cellY = (int32_t)std::floor(position.y / m_activationConfig.cellSize);
+    return ((uint64_t)(uint32_t)cellX << 32) | (uint32_t)cellY;
+}
+
+void Physics::UpdateActivation(b2Vec2 focus) {
+    const float cellSize = m_activationConfig.cellSize;
+    if (cellSize <= 0.0f)
+        return;
+
+    // Active groups that drifted out of range
+    for (size_t i = 0; i < m_activeGroups.size();) {
+        uint32_t groupIndex = m_activeGroups[i];
+        const ActivationGroup& group = m_activationGroups[groupIndex];
+        b2BodyId firstBodyId = m_activationBodies[group.firstBody];
+        // Bodies disabled by their owner (pooled bullets) are left alone
+        if (b2Body_IsEnabled(firstBodyId)) {
+            b2Vec2 position = m_currTransforms[firstBodyId.index1].p;
+            uint64_t cellKey = GetCellKey(position);
+            float distance = GetCellDistance((int32_t)(cellKey >> 32), (int32_t)(uint32_t)cellKey, cellSize, focus);
+            if (distance > m_activationConfig.deactivateRadius) {
+                m_activationGroups[groupIndex].cellKey = cellKey;
+                m_parkedCells[cellKey].push_back(groupIndex);
+                SetGroupParked(groupIndex, true);
+                m_activeGroups[i] = m_activeGroups.back();
+                m_activeGroups.pop_back();
+                continue;
+            }
+        }
+        i++;
+    }
+
+    // Parked cells that came back in range
+    if (m_parkedCells.empty())
+        return;
+    float radius = m_activationConfig.activateRadius;
+    int32_t minX = (int32_t)std::floor((focus.x - radius) / cellSize);
+    int32_t maxX = (int32_t)std::floor((focus.x + radius) / cellSize);
+    int32_t minY = (int32_t)std::floor((focus.y - radius) / cellSize);
+    int32_t maxY = (int32_t)std::floor((focus.y + radius) / cellSize);
+    for (int32_t cellY = minY; cellY <= maxY; cellY++) {
+        for (int32_t cellX = minX; cellX <= maxX; cellX++) {
+            if (GetCellDistance(cellX, cellY, cellSize, focus) > radius)
+                continue;
+            auto it = m_parkedCells.find(((uint64_t)(uint32_t)cellX << 32) | (uint32_t)cellY);
+            if (it == m_parkedCells.end())
+                continue;
+            for (uint32_t groupIndex : it->second) {
+                SetGroupParked(groupIndex, false);
+                m_activeGroups.push_back(groupIndex);
+            }
+            m_parkedCells.erase(it);
+        }
+    }
+}
+
+size_t Physics::GetParkedGroupCount() const {
+    return m_activationGroups.size() - m_activeGroups.size();
+}
+
+void Physics::RegisterActivationGroup(const std::span<const b2BodyId>& bodyIds) {
+    uint32_t groupIndex = (uint32_t)m_activationGroups.size();
+    m_activationGroups.push_back(ActivationGroup{
+        .firstBody = (uint32_t)m_activationBodies.size(),
+        .bodyCount = (uint32_t)bodyIds.size(),
+        .isParked = false,
+        .cellKey = 0
+    });
+    for (b2BodyId bodyId : bodyIds) {
+        m_activationBodies.push_back(bodyId);
+        if (m_activationGroupOfBody.size() <= (size_t)bodyId.index1)
+            m_activationGroupOfBody.resize(bodyId.index1 + 1, -1);
+        m_activationGroupOfBody[bodyId.index1] = (int)groupIndex;
+    }
+    m_activeGroups.push_back(groupIndex);
+}
+
+void Physics::SetGroupParked(uint32_t groupIndex, bool isParked) {
+    ActivationGroup& group = m_activationGroups[groupIndex];
+    group.isParked = isParked;
+    for (uint32_t i = group.firstBody; i < group.firstBody + group.bodyCount; i++) {
+        if (isParked)
+            b2Body_Disable(m_activationBodies[i]);
+        else
+            b2Body_Enable(m_activationBodies[i]);
+    }
 }
 
-void Physics::Update(float timestep) {
-    b2World_Step(m_worldId, timestep, PHYSICS_SUBSTEP_COUNT);
+void Physics::ForgetParkedGroup(b2BodyId bodyId) {
+    if ((size_t)bodyId.index1 >= m_activationGroupOfBody.size() || m_activationGroupOfBody[bodyId.index1] < 0)
+        return;
+    uint32_t groupIndex = (uint32_t)m_activationGroupOfBody[bodyId.index1];
+    ActivationGroup& group = m_activationGroups[groupIndex];
+    if (!group.isParked)
+        return;
+
+    std::vector<uint32_t>& cell = m_parkedCells[group.cellKey];
+    cell.erase(std::find(cell.begin(), cell.end(), groupIndex));
+    if (cell.empty())
+        m_parkedCells.erase(group.cellKey);
+    group.isParked = false;
+    m_activeGroups.push_back(groupIndex);
+}
+
+void Physics::DisableBody(b2BodyId bodyId) {
+    ForgetParkedGroup(bodyId);
+    b2Body_Disable(bodyId);
+}
+
+void Physics::EnableBody(b2BodyId bodyId, b2Vec2 position) {
+    ForgetParkedGroup(bodyId);
+    b2Body_SetTransform(bodyId, position, b2Rot_identity);
+    b2Body_SetLinearVelocity(bodyId, b2Vec2_zero);
+    b2Body_SetAngularVelocity(bodyId, 0.0f);
+    b2Body_Enable(bodyId);
+    // Don't interpolate from wherever the body was before
+    SetTransformCache(bodyId, b2Body_GetTransform(bodyId));
+    // Undrained hits belong to the body's previous life
+    void* pUserData = b2Body_GetUserData(bodyId);
+    m_hits.erase(std::remove_if(m_hits.begin(), m_hits.end(), [pUserData](const PhysicsHit& hit) {
+        return hit.pUserDataA == pUserData || hit.pUserDataB == pUserData;
+    }), m_hits.end());
+}
+
+// Any padding of the snapshot records is spelled out and zeroed, so equal states save equal bytes
+struct PhysicsSnapshotHeader {
+    uint32_t bodyCount;
+    uint32_t jointCount;
+    uint32_t activationGroupCount;
+    uint32_t activeGroupCount;
+    uint32_t moverCount;
+    float accumulator;
+    int substepCount;
+};
+
+struct PhysicsSnapshotBody {
+    b2Transform transform;
+    b2Vec2 linearVelocity;
+    float angularVelocity;
+    uint8_t awake;
+    uint8_t enabled;
+    uint8_t padding[2];
+};
+static_assert(sizeof(PhysicsSnapshotBody) == 32);
+
+// Only distance joints are created through Physics
+struct PhysicsSnapshotJoint {
+    float length;
+    float minLength;
+    float maxLength;
+    float hertz;
+    float dampingRatio;
+};
+
+// Activation bookkeeping, so parked and active groups match the enabled state of their bodies again
+struct PhysicsSnapshotActivationGroup {
+    uint64_t cellKey;
+    uint8_t isParked;
+    uint8_t padding[7];
+};
+static_assert(sizeof(PhysicsSnapshotActivationGroup) == 16);
+
+struct PhysicsSnapshotMover {
+    b2Vec2 velocity;
+    b2Vec2 groundNormal;
+    uint8_t isGrounded;
+    uint8_t padding[3];
+};
+static_assert(sizeof(PhysicsSnapshotMover) == 20);
+
+// Bytes after the header
+static size_t GetSnapshotSize(const PhysicsSnapshotHeader& header) {
+    return header.bodyCount * sizeof(PhysicsSnapshotBody) +
+        header.jointCount * sizeof(PhysicsSnapshotJoint) +
+        header.activationGroupCount * sizeof(PhysicsSnapshotActivationGroup) +
+        header.activeGroupCount * sizeof(uint32_t) +
+        header.moverCount * sizeof(PhysicsSnapshotMover);
+}
+
+void Physics::SaveSnapshot(PhysicsSnapshot& snapshot) const {
+    PhysicsSnapshotHeader header = {
+        .bodyCount = (uint32_t)m_bodies.size(),
+        .jointCount = (uint32_t)m_joints.size(),
+        .activationGroupCount = (uint32_t)m_activationGroups.size(),
+        .activeGroupCount = (uint32_t)m_activeGroups.size(),
+        .moverCount = (uint32_t)m_movers.size(),
+        .accumulator = m_accumulator,
+        .substepCount = m_substepCount
+    };
+    snapshot.data.resize(sizeof(header) + GetSnapshotSize(header));
+
+    uint8_t* pOut = snapshot.data.data();
+    std::memcpy(pOut, &header, sizeof(header));
+    pOut += sizeof(header);
+    for (b2BodyId bodyId : m_bodies) {
+        PhysicsSnapshotBody body = {
+            .transform = b2Body_GetTransform(bodyId),
+            .linearVelocity = b2Body_GetLinearVelocity(bodyId),
+            .angularVelocity = b2Body_GetAngularVelocity(bodyId),
+            .awake = b2Body_IsAwake(bodyId),
+            .enabled = b2Body_IsEnabled(bodyId),
+            .padding = {}
+        };
+        std::memcpy(pOut, &body, sizeof(body));
+        pOut += sizeof(body);
+    }
+    for (b2JointId jointId : m_joints) {
+        PhysicsSnapshotJoint joint = {
+            .length = b2DistanceJoint_GetLength(jointId),
+            .minLength = b2DistanceJoint_GetMinLength(jointId),
+            .maxLength = b2DistanceJoint_GetMaxLength(jointId),
+            .hertz = b2DistanceJoint_GetSpringHertz(jointId),
+            .dampingRatio = b2DistanceJoint_GetSpringDampingRatio(jointId)
+        };
+        std::memcpy(pOut, &joint, sizeof(joint));
+        pOut += sizeof(joint);
+    }
+    for (const ActivationGroup& group : m_activationGroups) {
+        PhysicsSnapshotActivationGroup activationGroup = { .cellKey = group.cellKey, .isParked = group.isParked, .padding = {} };
+        std::memcpy(pOut, &activationGroup, sizeof(activationGroup));
+        pOut += sizeof(activationGroup);
+    }
+    std::memcpy(pOut, m_activeGroups.data(), m_activeGroups.size() * sizeof(uint32_t));
+    pOut += m_activeGroups.size() * sizeof(uint32_t);
+    for (const Mover& mover : m_movers) {
+        PhysicsSnapshotMover snapshotMover = {
+            .velocity = mover.velocity,
+            .groundNormal = mover.groundNormal,
+            .isGrounded = mover.isGrounded,
+            .padding = {}
+        };
+        std::memcpy(pOut, &snapshotMover, sizeof(snapshotMover));
+        pOut += sizeof(snapshotMover);
+    }
+}
+
+bool Physics::RestoreSnapshot(const PhysicsSnapshot& snapshot) {
+    PhysicsSnapshotHeader header;
+    if (snapshot.data.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, snapshot.data.data(), sizeof(header));
+    if (header.bodyCount != m_bodies.size() || header.jointCount != m_joints.size() ||
+        header.activationGroupCount != m_activationGroups.size() || header.activeGroupCount > m_activationGroups.size() ||
+        header.moverCount != m_movers.size())
+        return false;
+    if (snapshot.data.size() != sizeof(header) + GetSnapshotSize(header))
+        return false;
+
+    const uint8_t* pBodies = snapshot.data.data() + sizeof(header);
+    for (size_t i = 0; i < m_bodies.size(); i++) {
+        b2BodyId bodyId = m_bodies[i];
+        PhysicsSnapshotBody body;
+        std::memcpy(&body, pBodies + i * sizeof(body), sizeof(body));
+        if (body.enabled)
+            b2Body_Enable(bodyId);
+        else
+            b2Body_Disable(bodyId);
+        b2Body_SetTransform(bodyId, body.transform.p, body.transform.q);
+        b2Body_SetLinearVelocity(bodyId, body.linearVelocity);
+        b2Body_SetAngularVelocity(bodyId, body.angularVelocity);
+        // Nothing to interpolate from, the snapshot is where the bodies are now
+        SetTransformCache(bodyId, body.transform);
+    }
+
+    const uint8_t* pJoints = pBodies + m_bodies.size() * sizeof(PhysicsSnapshotBody);
+    for (size_t i = 0; i < m_joints.size(); i++) {
+        b2JointId jointId = m_joints[i];
+        PhysicsSnapshotJoint joint;
+        std::memcpy(&joint, pJoints + i * sizeof(joint), sizeof(joint));
+        b2DistanceJoint_SetLength(jointId, joint.length);
+        b2DistanceJoint_SetLengthRange(jointId, joint.minLength, joint.maxLength);
+        b2DistanceJoint_SetSpringHertz(jointId, joint.hertz);
+        b2DistanceJoint_SetSpringDampingRatio(jointId, joint.dampingRatio);
+    }
+
+    // Setting velocities wakes bodies up, so sleep is restored last
+    for (size_t i = 0; i < m_bodies.size(); i++) {
+        PhysicsSnapshotBody body;
+        std::memcpy(&body, pBodies + i * sizeof(body), sizeof(body));
+        if (body.enabled)
+            b2Body_SetAwake(m_bodies[i], body.awake);
+    }
+
+    // The bodies are already enabled/disabled as saved, only the lists need rebuilding
+    const uint8_t* pGroups = pJoints + m_joints.size() * sizeof(PhysicsSnapshotJoint);
+    m_parkedCells.clear();
+    for (size_t i = 0; i < m_activationGroups.size(); i++) {
+        PhysicsSnapshotActivationGroup activationGroup;
+        std::memcpy(&activationGroup, pGroups + i * sizeof(activationGroup), sizeof(activationGroup));
+        m_activationGroups[i].cellKey = activationGroup.cellKey;
+        m_activationGroups[i].isParked = activationGroup.isParked;
+        if (activationGroup.isParked)
+            m_parkedCells[activationGroup.cellKey].push_back((uint32_t)i);
+    }
+    m_activeGroups.resize(header.activeGroupCount);
+    const uint8_t* pActiveGroups = pGroups + m_activationGroups.size() * sizeof(PhysicsSnapshotActivationGroup);
+    std::memcpy(m_activeGroups.data(), pActiveGroups, header.activeGroupCount * sizeof(uint32_t));
+
+    const uint8_t* pMovers = pActiveGroups + header.activeGroupCount * sizeof(uint32_t);
+    for (size_t i = 0; i < m_movers.size(); i++) {
+        PhysicsSnapshotMover snapshotMover;
+        std::memcpy(&snapshotMover, pMovers + i * sizeof(snapshotMover), sizeof(snapshotMover));
+        m_movers[i].velocity = snapshotMover.velocity;
+        m_movers[i].groundNormal = snapshotMover.groundNormal;
+        m_movers[i].isGrounded = snapshotMover.isGrounded;
+    }
+
+    m_accumulator = header.accumulator;
+    m_substepCount = header.substepCount;
+    m_hits.clear();
+    return true;
+}
+
+void Physics::QueueRayCast(b2Vec2 origin, b2Vec2 translation, void* pUserData, PhysicsCategory category) {
+    m_rayCasts.push_back(RayCast{ .origin = origin, .translation = translation, .pUserData = pUserData, .category = category });
 }
 
-PhysicsRigidBox Physics::CreateBox(b2Vec2 position, b2Vec2 size, bool dynamic) {
+void Physics::CastRayRange(int startIndex, int endIndex, uint32_t, void* pContext) {
+    Physics& physics = *static_cast<Physics*>(pContext);
+    for (int i = startIndex; i < endIndex; i++) {
+        const RayCast& ray = physics.m_rayCasts[i];
+        b2QueryFilter filter = { .categoryBits = ray.category, .maskBits = GetCategoryMask(ray.category) };
+        b2RayResult result = b2World_CastRayClosest(physics.m_worldId, ray.origin, ray.translation, filter);
+        physics.m_rayHitFlags[i] = result.hit;
+        if (!result.hit)
+            continue;
+        physics.m_rayHits[i] = PhysicsHit{
+            .pUserDataA = ray.pUserData,
+            .pUserDataB = b2Body_GetUserData(b2Shape_GetBody(result.shapeId)),
+            .point = result.point,
+            .normal = result.normal
+        };
+    }
+}
+
+void Physics::CastQueuedRays(std::vector<PhysicsHit>& hits) {
+    hits.clear();
+    if (m_rayCasts.empty())
+        return;
+
+    // Queries only read the world, so the rays don't depend on each other
+    int rayCount = (int)m_rayCasts.size();
+    m_rayHits.resize(rayCount);
+    m_rayHitFlags.resize(rayCount);
+    if (m_pTaskSystem != nullptr)
+        m_pTaskSystem->Wait(m_pTaskSystem->Submit(CastRayRange, rayCount, PHYSICS_RAYS_PER_RANGE, this));
+    else
+        CastRayRange(0, rayCount, 0, this);
+
+    for (int i = 0; i < rayCount; i++) {
+        if (m_rayHitFlags[i])
+            hits.push_back(m_rayHits[i]);
+    }
+    m_rayCasts.clear();
+}
+
+void Physics::DrainHits(std::vector<PhysicsHit>& hits) {
+    hits.clear();
+    std::swap(hits, m_hits);
+}
+
+// The query belongs to every category, so it is never rejected by the mask of a shape
+static b2QueryFilter MakeQueryFilter(uint64_t categoryMask) {
+    return b2QueryFilter{ .categoryBits = PHYSICS_QUERY_ALL_CATEGORIES, .maskBits = categoryMask };
+}
+
+static PhysicsQueryHit MakeQueryHit(b2ShapeId shapeId) {
+    b2BodyId bodyId = b2Shape_GetBody(shapeId);
+    return PhysicsQueryHit{
+        .shapeId = shapeId,
+        .bodyId = bodyId,
+        .pUserData = b2Body_GetUserData(bodyId),
+        .point = b2Vec2_zero,
+        .normal = b2Vec2_zero,
+        .fraction = 0.0f,
+        .distance = 0.0f
+    };
+}
+
+struct PhysicsOverlapContext {
+    std::span<PhysicsQueryHit> results;
+    size_t count;
+};
+
+static bool CollectOverlap(b2ShapeId shapeId, void* pContext) {
+    PhysicsOverlapContext& context = *static_cast<PhysicsOverlapContext*>(pContext);
+    PhysicsQueryHit hit = MakeQueryHit(shapeId);
+    hit.point = b2Body_GetPosition(hit.bodyId);
+    context.results[context.count++] = hit;
+    return context.count < context.results.size();
+}
+
+struct PhysicsNearestContext {
+    std::span<PhysicsQueryHit> results;
+    size_t count;
+    b2Vec2 position;
+    float radius;
+    // Skip static and kinematic bodies
+    bool dynamicOnly;
+};
+
+static bool CollectNearest(b2ShapeId shapeId, void* pContext) {
+    PhysicsNearestContext& context = *static_cast<PhysicsNearestContext*>(pContext);
+    PhysicsQueryHit hit = MakeQueryHit(shapeId);
+    if (context.dynamicOnly && b2Body_GetType(hit.bodyId) != b2_dynamicBody)
+        return true;
+    hit.point = b2Shape_GetClosestPoint(shapeId, context.position);
+    hit.distance = b2Distance(hit.point, context.position);
+    if (hit.distance > context.radius)
+        return true;
+
+    // Replace the entry of the same entity, or the farthest one once the buffer is full
+    auto isSameEntity = [&](const PhysicsQueryHit& other) {
+        return hit.pUserData != nullptr ? other.pUserData == hit.pUserData : B2_ID_EQUALS(other.bodyId, hit.bodyId);
+    };
+    size_t slot = context.count;
+    for (size_t i = 0; i < context.count; i++) {
+        if (isSameEntity(context.results[i])) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < context.count) {
+        if (context.results[slot].distance <= hit.distance)
+            return true;
+    }
+    else if (context.count < context.results.size()) {
+        context.count++;
+    }
+    else {
+        slot = context.count - 1;
+        if (context.results[slot].distance <= hit.distance)
+            return true;
+    }
+    // Insertion sort from the freed slot towards the front
+    while (slot > 0 && context.results[slot - 1].distance > hit.distance) {
+        context.results[slot] = context.results[slot - 1];
+        slot--;
+    }
+    context.results[slot] = hit;
+    return true;
+}
+
+struct PhysicsCastContext {
+    PhysicsQueryHit hit;
+    bool hasHit;
+};
+
+static float KeepClosestCast(b2ShapeId shapeId, b2Vec2 point, b2Vec2 normal, float fraction, void* pContext) {
+    PhysicsCastContext& context = *static_cast<PhysicsCastContext*>(pContext);
+    context.hit = MakeQueryHit(shapeId);
+    context.hit.point = point;
+    context.hit.normal = normal;
+    context.hit.fraction = fraction;
+    context.hasHit = true;
+    // Clips the cast, only closer shapes are reported from now on
+    return fraction;
+}
+
+size_t Physics::QueryAABB(b2AABB box, std::span<PhysicsQueryHit> results, uint64_t categoryMask) const {
+    if (results.empty())
+        return 0;
+    PhysicsOverlapContext context = { .results = results, .count = 0 };
+    b2World_OverlapAABB(m_worldId, box, MakeQueryFilter(categoryMask), CollectOverlap, &context);
+    return context.count;
+}
+
+bool Physics::CastRay(b2Vec2 origin, b2Vec2 translation, PhysicsQueryHit& hit, uint64_t categoryMask) const {
+    PhysicsCastContext context = {};
+    b2World_CastRay(m_worldId, origin, translation, MakeQueryFilter(categoryMask), KeepClosestCast, &context);
+    if (context.hasHit)
+        hit = context.hit;
+    return context.hasHit;
+}
+
+bool Physics::CastShape(const b2ShapeProxy& proxy, b2Vec2 translation, PhysicsQueryHit& hit, uint64_t categoryMask) const {
+    PhysicsCastContext context = {};
+    b2World_CastShape(m_worldId, &proxy, translation, MakeQueryFilter(categoryMask), KeepClosestCast, &context);
+    if (context.hasHit)
+        hit = context.hit;
+    return context.hasHit;
+}
+
+static size_t FindNearestInWorld(
+    b2WorldId worldId, b2Vec2 position, float radius, std::span<PhysicsQueryHit> results,
+    uint64_t categoryMask, bool dynamicOnly
+) {
+    if (results.empty())
+        return 0;
+    PhysicsNearestContext context = {
+        .results = results,
+        .count = 0,
+        .position = position,
+        .radius = radius,
+        .dynamicOnly = dynamicOnly
+    };
+    b2AABB box = {
+        .lowerBound = b2Vec2{ position.x - radius, position.y - radius },
+        .upperBound = b2Vec2{ position.x + radius, position.y + radius }
+    };
+    b2World_OverlapAABB(worldId, box, MakeQueryFilter(categoryMask), CollectNearest, &context);
+    return context.count;
+}
+
+size_t Physics::FindNearest(b2Vec2 position, float radius, std::span<PhysicsQueryHit> results, uint64_t categoryMask) const {
+    return FindNearestInWorld(m_worldId, position, radius, results, categoryMask, false);
+}
+
+void Physics::RunQuery(PhysicsQuery& query) const {
+    query.resultCount = 0;
+    switch (query.type) {
+    case PHYSICS_QUERY_AABB:
+        query.resultCount = QueryAABB(query.box, query.results, query.categoryMask);
+        break;
+    case PHYSICS_QUERY_RAY:
+        if (!query.results.empty())
+            query.resultCount = CastRay(query.origin, query.translation, query.results[0], query.categoryMask);
+        break;
+    case PHYSICS_QUERY_SHAPE:
+        if (!query.results.empty())
+            query.resultCount = CastShape(query.proxy, query.translation, query.results[0], query.categoryMask);
+        break;
+    case PHYSICS_QUERY_NEAREST:
+        query.resultCount = FindNearest(query.origin, query.radius, query.results, query.categoryMask);
+        break;
+    }
+}
+
+struct PhysicsQueryBatch {
+    const Physics* pPhysics;
+    std::span<PhysicsQuery> queries;
+};
+
+void Physics::RunQueryRange(int startIndex, int endIndex, uint32_t, void* pContext) {
+    const PhysicsQueryBatch& batch = *static_cast<PhysicsQueryBatch*>(pContext);
+    for (int i = startIndex; i < endIndex; i++) {
+        batch.pPhysics->RunQuery(batch.queries[i]);
+    }
+}
+
+void Physics::RunQueries(std::span<PhysicsQuery> queries) const {
+    // Every query writes only to its own results
+    PhysicsQueryBatch batch = { .pPhysics = this, .queries = queries };
+    int queryCount = (int)queries.size();
+    if (m_pTaskSystem != nullptr && queryCount > PHYSICS_QUERIES_PER_RANGE)
+        m_pTaskSystem->Wait(m_pTaskSystem->Submit(RunQueryRange, queryCount, PHYSICS_QUERIES_PER_RANGE, &batch));
+    else
+        RunQueryRange(0, queryCount, 0, &batch);
+}
+
+size_t Physics::Explode(const PhysicsExplosion& explosion, std::span<PhysicsQueryHit> affected) {
+    // box2d finds the shapes through the broadphase, so only bodies in range are touched
+    b2ExplosionDef explosionDef = b2DefaultExplosionDef();
+    explosionDef.maskBits = explosion.categoryMask;
+    explosionDef.position = explosion.position;
+    explosionDef.radius = explosion.radius;
+    explosionDef.falloff = explosion.falloff;
+    explosionDef.impulsePerLength = explosion.impulsePerLength;
+    b2World_Explode(m_worldId, &explosionDef);
+
+    // b2World_Explode only pushes dynamic bodies, walls and movers in range are not affected
+    return FindNearestInWorld(
+        m_worldId, explosion.position, explosion.radius + explosion.falloff, affected, explosion.categoryMask, true);
+}
+
+PhysicsRigidBox Physics::CreateBox(b2Vec2 position, b2Vec2 size, bool dynamic, PhysicsCategory category) {
     PhysicsRigidBox object;
 
     b2BodyDef bodyDef = b2DefaultBodyDef();
     bodyDef.type = (dynamic ? b2_dynamicBody : b2_staticBody);
     bodyDef.position = position;
     object.Id = b2CreateBody(m_worldId, &bodyDef);
+    RegisterBody(object.Id);
     object.polygon = b2MakeBox(size.x / 2.0f, size.y / 2.0f);
     b2ShapeDef shapeDef = b2DefaultShapeDef();
     shapeDef.material.friction = 0.3f;
+    shapeDef.filter = MakeFilter(category);
     b2CreatePolygonShape(object.Id, &shapeDef, &object.polygon);
+    if (dynamic)
+        RegisterActivationGroup(std::span<const b2BodyId>(&object.Id, 1));
+
+    return object;
+}
+
+PhysicsChainBody Physics::CreateChainBody(const std::span<const std::vector<b2Vec2>>& loops, PhysicsCategory category) {
+    PhysicsChainBody object;
+
+    b2BodyDef bodyDef = b2DefaultBodyDef();
+    bodyDef.type = b2_staticBody;
+    object.Id = b2CreateBody(m_worldId, &bodyDef);
+    RegisterBody(object.Id);
+    b2SurfaceMaterial material = b2DefaultSurfaceMaterial();
+    material.friction = 0.3f;
+    for (const auto& loop : loops) {
+        b2ChainDef chainDef = b2DefaultChainDef();
+        chainDef.points = loop.data();
+        chainDef.count = (int)loop.size();
+        chainDef.materials = &material;
+        chainDef.materialCount = 1;
+        chainDef.filter = MakeFilter(category);
+        chainDef.isLoop = true;
+        object.chains.push_back(b2CreateChain(object.Id, &chainDef));
+    }
+
+    return object;
+}
+
+PhysicsMover Physics::CreateMover(b2Vec2 position, const b2Capsule& capsule, float mass, PhysicsCategory category) {
+    PhysicsMover object;
+
+    b2BodyDef bodyDef = b2DefaultBodyDef();
+    bodyDef.type = b2_kinematicBody;
+    bodyDef.position = position;
+    bodyDef.fixedRotation = true;
+    object.Id = b2CreateBody(m_worldId, &bodyDef);
+    RegisterBody(object.Id);
+    // The shape is only for the others: contacts, bullets and rays
+    b2ShapeDef shapeDef = b2DefaultShapeDef();
+    shapeDef.filter = MakeFilter(category);
+    b2CreateCapsuleShape(object.Id, &shapeDef, &capsule);
 
+    object.index = (uint32_t)m_movers.size();
+    m_movers.push_back(Mover{
+        .bodyId = object.Id,
+        .capsule = capsule,
+        .mass = mass,
+        .category = category,
+        .velocity = b2Vec2_zero,
+        .isGrounded = false,
+        .groundNormal = b2Vec2_zero,
+        .followers = {},
+        .followerOffsets = {}
+    });
     return object;
 }
 
-PhysicsRigidCircle Physics::CreateCircle(b2Vec2 position, float radius, bool dynamic) {
+void Physics::ApplyMoverImpulse(const PhysicsMover& mover, b2Vec2 impulse) {
+    Mover& state = m_movers[mover.index];
+    state.velocity = b2MulAdd(state.velocity, 1.0f / state.mass, impulse);
+}
+
+b2Vec2 Physics::GetMoverVelocity(const PhysicsMover& mover) const {
+    return m_movers[mover.index].velocity;
+}
+
+void Physics::AttachVisualSoftBody(
+    const PhysicsMover& mover, const PhysicsSoftBody& softBody, const std::span<const b2Vec2>& restOffsets
+) {
+    Mover& state = m_movers[mover.index];
+    for (size_t i = 0; i < softBody.vertices.size(); i++) {
+        b2BodyId bodyId = softBody.vertices[i].Id;
+        b2ShapeId shapeId;
+        b2Body_GetShapes(bodyId, &shapeId, 1);
+        b2Filter filter = b2Shape_GetFilter(shapeId);
+        filter.maskBits = 0;
+        b2Shape_SetFilter(shapeId, filter);
+        b2Body_SetGravityScale(bodyId, 0.0f);
+        state.followers.push_back(bodyId);
+        state.followerOffsets.push_back(restOffsets[i]);
+    }
+}
+
+PhysicsRigidCircle Physics::CreateCircle(
+    b2Vec2 position, float radius, bool dynamic, bool enableContactEvents, PhysicsCategory category
+) {
     PhysicsRigidCircle object;
 
     b2BodyDef bodyDef = b2DefaultBodyDef();
     bodyDef.type = (dynamic ? b2_dynamicBody : b2_staticBody);
     bodyDef.position = position;
     object.Id = b2CreateBody(m_worldId, &bodyDef);
+    RegisterBody(object.Id);
     object.circle = b2Circle{ .center = b2Vec2_zero, .radius = radius };
     b2ShapeDef shapeDef = b2DefaultShapeDef();
     shapeDef.material.friction = 0.3f;
+    shapeDef.enableContactEvents = enableContactEvents;
+    shapeDef.filter = MakeFilter(category);
     b2CreateCircleShape(object.Id, &shapeDef, &object.circle);
+    if (dynamic)
+        RegisterActivationGroup(std::span<const b2BodyId>(&object.Id, 1));
 
     return object;
 }
 
 PhysicsSoftBody Physics::CreateSoftBody(
     b2Vec2 position,
+    const std::span<const b2Vec2>& vertices,
+    const std::span<const PhysicsSoftBodyJointConn>& jointConns,
+    PhysicsCategory category
+) {
+    return CreateSoftBody(position, MakeSoftBodyTemplate(vertices, jointConns), category);
+}
+
+PhysicsSoftBodyTemplate Physics::MakeSoftBodyTemplate(
     const std::span<const b2Vec2>& vertices,
     const std::span<const PhysicsSoftBodyJointConn>& jointConns
+) {
+    PhysicsSoftBodyTemplate softBodyTemplate;
+    softBodyTemplate.vertexOffsets.assign(vertices.begin(), vertices.end());
+    softBodyTemplate.jointConns.assign(jointConns.begin(), jointConns.end());
+    for (const auto& conn : jointConns) {
+        softBodyTemplate.jointLengths.push_back(b2Distance(vertices[conn.vertex1], vertices[conn.vertex2]));
+    }
+
+    softBodyTemplate.vertexCircle = b2Circle{ .center = b2Vec2_zero, .radius = PHYSICS_SOFTBODY_VERTEX_RADIUS };
+    softBodyTemplate.bodyDef = b2DefaultBodyDef();
+    softBodyTemplate.bodyDef.type = b2_dynamicBody;
+    softBodyTemplate.shapeDef = b2DefaultShapeDef();
+    softBodyTemplate.shapeDef.material.friction = 0.3f;
+
+    b2DistanceJointDef& jointDef = softBodyTemplate.jointDef;
+    jointDef = b2DefaultDistanceJointDef();
+    jointDef.localAnchorA = b2Vec2_zero;
+    jointDef.localAnchorB = b2Vec2_zero;
+    jointDef.collideConnected = false;
+    jointDef.dampingRatio = 0.9f;
+    jointDef.hertz = 10.0f;
+    jointDef.minLength = 0.15f;
+    jointDef.maxLength = 3.0f;
+    jointDef.enableSpring = true;
+    jointDef.enableLimit = true;
+
+    return softBodyTemplate;
+}
+
+PhysicsSoftBody Physics::CreateSoftBody(
+    b2Vec2 position,
+    const PhysicsSoftBodyTemplate& softBodyTemplate,
+    PhysicsCategory category
 ) {
     PhysicsSoftBody object;
+    object.vertices.reserve(softBodyTemplate.vertexOffsets.size());
+    object.joints.reserve(softBodyTemplate.jointConns.size());
 
-    for (const auto& vertex : vertices) {
-        object.vertices.push_back(CreateCircle(b2Add(position, vertex), 0.02f, true));
+    // Neighbouring vertices are close enough to overlap, a shared negative group keeps them out of
+    // the pair list (the joints/constraints already hold them apart)
+    b2ShapeDef shapeDef = softBodyTemplate.shapeDef;
+    shapeDef.filter = MakeFilter(category, m_nextSoftBodyGroup--);
+    b2BodyDef bodyDef = softBodyTemplate.bodyDef;
+    for (const auto& offset : softBodyTemplate.vertexOffsets) {
+        bodyDef.position = b2Add(position, offset);
+        PhysicsRigidCircle vertex;
+        vertex.Id = b2CreateBody(m_worldId, &bodyDef);
+        vertex.circle = softBodyTemplate.vertexCircle;
+        b2CreateCircleShape(vertex.Id, &shapeDef, &vertex.circle);
+        RegisterBody(vertex.Id);
+        object.vertices.push_back(vertex);
     }
-    for (const auto& conn : jointConns) {
-        b2DistanceJointDef jointDef = b2DefaultDistanceJointDef();
+
+    // The vertices are parked and woken up together, a half-disabled softbody would tear apart
+    std::vector<b2BodyId> vertexIds;
+    for (const auto& vertex : object.vertices) {
+        vertexIds.push_back(vertex.Id);
+    }
+    RegisterActivationGroup(vertexIds);
+
+    if (m_softBodySolver == PHYSICS_SOFTBODY_SOLVER_XPBD) {
+        std::vector<XpbdConstraintDef> constraints;
+        for (size_t i = 0; i < softBodyTemplate.jointConns.size(); i++) {
+            constraints.push_back(XpbdConstraintDef{
+                .vertex1 = softBodyTemplate.jointConns[i].vertex1,
+                .vertex2 = softBodyTemplate.jointConns[i].vertex2,
+                .restLength = softBodyTemplate.jointLengths[i]
+            });
+        }
+        const b2DistanceJointDef& jointDef = softBodyTemplate.jointDef;
+        m_pXpbdSolver->Add(vertexIds, constraints, XpbdMaterial{
+            .hertz = jointDef.hertz,
+            .dampingRatio = jointDef.dampingRatio,
+            .minLength = jointDef.minLength,
+            .maxLength = jointDef.maxLength
+        });
+        return object;
+    }
+
+    b2DistanceJointDef jointDef = softBodyTemplate.jointDef;
+    for (size_t i = 0; i < softBodyTemplate.jointConns.size(); i++) {
+        const PhysicsSoftBodyJointConn& conn = softBodyTemplate.jointConns[i];
         jointDef.bodyIdA = object.vertices[conn.vertex1].Id;
         jointDef.bodyIdB = object.vertices[conn.vertex2].Id;
-        jointDef.localAnchorA = b2Vec2_zero;
-        jointDef.localAnchorB = b2Vec2_zero;
-        jointDef.collideConnected = false;
-        jointDef.dampingRatio = 0.9f;
-        jointDef.hertz = 10.0f;
-        jointDef.minLength = 0.15f;
-        jointDef.maxLength = 3.0f;
-        jointDef.length = b2Distance(b2Body_GetWorldPoint(jointDef.bodyIdA, jointDef.localAnchorA), b2Body_GetWorldPoint(jointDef.bodyIdB, jointDef.localAnchorB));
-        jointDef.enableSpring = true;
-        jointDef.enableLimit = true;
+        jointDef.length = softBodyTemplate.jointLengths[i];
         object.joints.push_back(b2CreateDistanceJoint(m_worldId, &jointDef));
+        m_joints.push_back(object.joints.back());
     }
 
     return object;
 }
+
+std::vector<PhysicsSoftBody> Physics::CreateSoftBodies(
+    const std::span<const b2Vec2>& positions,
+    const PhysicsSoftBodyTemplate& softBodyTemplate,
+    PhysicsCategory category
+) {
+    std::vector<PhysicsSoftBody> objects;
+    objects.reserve(positions.size());
+    // Every copy registers its vertices, grow the registry once up front
+    m_bodies.reserve(m_bodies.size() + positions.size() * softBodyTemplate.vertexOffsets.size());
+    for (const auto& position : positions) {
+        objects.push_back(CreateSoftBody(position, softBodyTemplate, category));
+    }
+    return objects;
+}
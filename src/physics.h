@@ -1,33 +1,228 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <span>
 #include "box2d/box2d.h"
+#include "physics_state_trace.h"
+#include "physics_telemetry.h"
+#include "triple_buffer.h"
+
+class Physics;
+class TaskSystem;
+class XpbdSolver;
 
 b2Vec2 operator+(b2Vec2 left, b2Vec2 right);
 
 enum {
-    PHYSICS_SUBSTEP_COUNT = 8
+    PHYSICS_MIN_SUBSTEP_COUNT = 4,
+    PHYSICS_MAX_SUBSTEP_COUNT = 8,
+    // Joints + contacts at which the maximum substep count is wanted
+    PHYSICS_STRESS_CONSTRAINT_COUNT = 512,
+    // Steps a single Update may take to catch up, time beyond that is dropped
+    PHYSICS_MAX_CATCHUP_STEPS = 5,
+    // Publishes whose changed bodies are remembered; a frame older than that is copied whole
+    PHYSICS_FRAME_HISTORY = 4,
+    // Rays cast by one task range, below that the batch runs on the calling thread
+    PHYSICS_RAYS_PER_RANGE = 64,
+    // Queries run by one task range in RunQueries
+    PHYSICS_QUERIES_PER_RANGE = 16,
+    // Collide/solve/cast rounds a mover takes per step, and the collision planes it keeps per round
+    PHYSICS_MOVER_ITERATION_COUNT = 5,
+    PHYSICS_MOVER_PLANE_CAPACITY = 8
+};
+
+// How the vertices of a softbody are held together
+enum PhysicsSoftBodySolver {
+    // box2d distance joints with springs and limits
+    PHYSICS_SOFTBODY_SOLVER_JOINTS,
+    // Jointless vertices, constrained by an XpbdSolver after every world step
+    PHYSICS_SOFTBODY_SOLVER_XPBD
+};
+
+constexpr float PHYSICS_TIMESTEP = 1 / 60.0f;
+constexpr float PHYSICS_STEP_BUDGET_MS = 2.0f;
+// A mover stops iterating once a round moves it less than this
+constexpr float PHYSICS_MOVER_TOLERANCE = 0.01f;
+// How far a dynamic body can push a mover back per step, static geometry is rigid
+constexpr float PHYSICS_MOVER_DYNAMIC_PUSH_LIMIT = 0.025f;
+// Rate (1/s) at which the visual softbody of a mover closes the gap to its rest shape
+constexpr float PHYSICS_MOVER_FOLLOW_RATE = 20.0f;
+// Walls whose normal is within about 45 degrees of up (against gravity) count as ground
+constexpr float PHYSICS_MOVER_GROUND_COS = 0.7f;
+// Ground friction, as in box2d's mover sample: the speed along the ground drops by
+// max(speed, PHYSICS_MOVER_STOP_SPEED) * PHYSICS_MOVER_FRICTION per second, below PHYSICS_MOVER_MIN_SPEED it stops
+constexpr float PHYSICS_MOVER_FRICTION = 8.0f;
+constexpr float PHYSICS_MOVER_STOP_SPEED = 3.0f;
+constexpr float PHYSICS_MOVER_MIN_SPEED = 0.1f;
+
+// The substep count is picked at runtime within [minCount, maxCount]:
+// more joints/contacts ask for more substeps, the measured step cost caps them to fit stepBudgetMs
+struct PhysicsSubstepConfig {
+    int minCount;
+    int maxCount;
+    float stepBudgetMs;
 };
 
 struct PhysicsRigidBox {
     b2BodyId Id;
     b2Polygon polygon;
     std::vector<b2Vec2> GetWorldVertices() const;
+    std::vector<b2Vec2> GetWorldVertices(b2Transform transform) const;
+    void SetUserData(void* pUserData);
 };
 
 struct PhysicsRigidCircle {
     b2BodyId Id;
     b2Circle circle;
     float GetRadius() const;
+    float GetMass() const;
     b2Vec2 GetPosition() const;
     std::vector<b2Vec2> GetWorldVertices() const;
+    std::vector<b2Vec2> GetWorldVertices(b2Transform transform) const;
     void ApplyImpulse(float impulseX, float impulseY);
+    void SetUserData(void* pUserData);
+};
+
+// Static body whose collision is made of closed chain loops (see LevelGeometryBuilder)
+struct PhysicsChainBody {
+    b2BodyId Id;
+    std::vector<b2ChainId> chains;
+    void SetUserData(void* pUserData);
+};
+
+// Kinematic character body moved by Physics (see CreateMover)
+struct PhysicsMover {
+    b2BodyId Id;
+    // Into the movers of the Physics that created it
+    uint32_t index;
+    void SetUserData(void* pUserData);
+};
+
+// How Player is driven, chosen by the game
+enum PlayerController {
+    // The softbody itself is pushed around, every vertex gets the impulse
+    PLAYER_CONTROLLER_SOFTBODY,
+    // A kinematic capsule (Physics::CreateMover) takes the impulses and the softbody follows it as visuals
+    PLAYER_CONTROLLER_MOVER
 };
 
 struct PhysicsSoftBody {
     std::vector<PhysicsRigidCircle> vertices;
+    // Empty when the softbody is handled by the XPBD solver
     std::vector<b2JointId> joints;
     void ApplyImpulse(float impulseX, float impulseY);
+    // Sets the user data of every vertex body
+    void SetUserData(void* pUserData);
+};
+
+// Two bodies started touching, at least one of them has contact events enabled
+struct PhysicsHit {
+    // User data of the two bodies (see SetUserData), may be null
+    void* pUserDataA;
+    void* pUserDataB;
+    b2Vec2 point;
+    // Points from A to B
+    b2Vec2 normal;
+};
+
+// State of every body and joint created through Physics, packed into one contiguous buffer
+// the layout is private to Physics; a snapshot only restores into the Physics that saved it
+struct PhysicsSnapshot {
+    std::vector<uint8_t> data;
+};
+
+// What a shape is, for collision filtering; each category collides only with the ones gameplay needs
+// (see GetCategoryMask in physics.cpp), so e.g. bullet-bullet pairs never reach the narrow phase
+enum PhysicsCategory : uint64_t {
+    // Level geometry, also the category of shapes created without one
+    PHYSICS_CATEGORY_WALL   = 0x1,
+    PHYSICS_CATEGORY_PLAYER = 0x2,
+    PHYSICS_CATEGORY_ENEMY  = 0x4,
+    PHYSICS_CATEGORY_BULLET = 0x8
+};
+
+// Category mask of queries that report shapes of any category
+constexpr uint64_t PHYSICS_QUERY_ALL_CATEGORIES = UINT64_MAX;
+
+// A shape found by a spatial query
+struct PhysicsQueryHit {
+    b2ShapeId shapeId;
+    b2BodyId bodyId;
+    // User data of the body (see SetUserData), may be null
+    void* pUserData;
+    // Casts -> point of impact; nearest -> closest point of the shape; AABB -> position of the body
+    b2Vec2 point;
+    // Casts only, surface normal at the point
+    b2Vec2 normal;
+    // Casts only, how much of the translation was travelled before the impact
+    float fraction;
+    // Nearest only, from the query position to the point
+    float distance;
+};
+
+// Radial impulse applied by Physics::Explode
+struct PhysicsExplosion {
+    b2Vec2 position;
+    // Shapes within radius get the full impulse, fading to none over the falloff distance beyond it
+    float radius;
+    float falloff;
+    // Per unit of perimeter facing the explosion, negative pulls shapes in
+    float impulsePerLength;
+    // PhysicsCategory bits of the shapes affected
+    uint64_t categoryMask = PHYSICS_QUERY_ALL_CATEGORIES;
+};
+
+enum PhysicsQueryType {
+    // Shapes whose AABB overlaps box
+    PHYSICS_QUERY_AABB,
+    // Closest shape hit by the ray from origin along translation
+    PHYSICS_QUERY_RAY,
+    // Closest shape hit by proxy moving along translation
+    PHYSICS_QUERY_SHAPE,
+    // Entities within radius of origin, closest first
+    PHYSICS_QUERY_NEAREST
+};
+
+// One query of a batch run by Physics::RunQueries; the fields not used by its type are ignored
+struct PhysicsQuery {
+    PhysicsQueryType type;
+    uint64_t categoryMask = PHYSICS_QUERY_ALL_CATEGORIES;
+    b2AABB box;
+    b2Vec2 origin;
+    b2Vec2 translation;
+    b2ShapeProxy proxy;
+    float radius;
+    // Filled by RunQueries, casts write at most one hit
+    std::span<PhysicsQueryHit> results;
+    size_t resultCount = 0;
+};
+
+// Dynamic bodies are grouped for activation (a softbody is one group) and bucketed into square cells
+// around a focus point (the player/camera): groups whose cell is farther than deactivateRadius are
+// disabled, keeping their state, and enabled again once their cell is within activateRadius
+// activateRadius < deactivateRadius, so groups near the edge don't flip every frame
+struct PhysicsActivationConfig {
+    // 0 -> regions are off, every body stays active
+    float cellSize;
+    float activateRadius;
+    float deactivateRadius;
+};
+
+// What the simulation side publishes after stepping, read by game logic and rendering
+struct PhysicsFrame {
+    // Transforms after the previous and the last step, indexed by b2BodyId::index1
+    std::vector<b2Transform> prevTransforms;
+    std::vector<b2Transform> currTransforms;
+    // When the last step finished
+    std::chrono::steady_clock::time_point stepTime;
+    int awakeBodyCount;
+    // Which publish the frame holds, so the next publish into it only copies what changed since
+    uint64_t serial = 0;
 };
 
 struct PhysicsSoftBodyJointConn {
@@ -35,20 +230,275 @@ struct PhysicsSoftBodyJointConn {
     uint32_t vertex2;
 };
 
+constexpr float PHYSICS_SOFTBODY_VERTEX_RADIUS = 0.02f;
+
+// Everything needed to instantiate a softbody, computed once and shared by all of its copies
+struct PhysicsSoftBodyTemplate {
+    std::vector<b2Vec2> vertexOffsets;
+    std::vector<PhysicsSoftBodyJointConn> jointConns;
+    // Rest length of each joint, taken from the distance between its vertex offsets
+    std::vector<float> jointLengths;
+    b2Circle vertexCircle;
+    b2BodyDef bodyDef;
+    b2ShapeDef shapeDef;
+    b2DistanceJointDef jointDef;
+};
+
+// While the physics thread runs (see Physics::StartThread), anything that reads or changes the world
+// directly must hold this lock; frame readers (GetRenderTransform, GetPosition, IsIdle...) don't need it
+// publishes the bodies created or teleported while it was held when it is released
+class PhysicsWorldLock {
+public:
+    PhysicsWorldLock(Physics& physics);
+    PhysicsWorldLock(const PhysicsWorldLock&) = delete;
+    ~PhysicsWorldLock();
+private:
+    Physics& m_physicsRef;
+    std::unique_lock<std::mutex> m_lock;
+};
+
 class Physics {
 public:
-    Physics();
-    // timestep -> interval of time between simulation iterations; recommanded to be constant
-    void Update(float timestep);
-    PhysicsRigidBox CreateBox(b2Vec2 position, b2Vec2 size, bool dynamic = false);
-    PhysicsRigidCircle CreateCircle(b2Vec2 position, float radius, bool dynamic = false);
+    // timestep -> fixed interval of time simulated by each world step
+    // pTaskSystem -> if not null, world steps are spread over its workers; it must outlive Physics
+    Physics(float timestep = PHYSICS_TIMESTEP, TaskSystem* pTaskSystem = nullptr);
+    ~Physics();
+    // elapsed -> real time since the previous call; it is accumulated and simulated in fixed steps
+    // returns the number of steps taken
+    // Not to be used while the physics thread runs
+    int Update(float elapsed);
+    // Steps the world on a dedicated thread at the fixed timestep until StopThread (or destruction)
+    // publishing a PhysicsFrame after every step
+    void StartThread();
+    void StopThread();
+    // Picks up the latest published frame, every frame reader below uses it until the next call
+    // call once per rendered frame
+    void AcquireFrame();
+    // How far the frame is between its last step and the next one, in [0, 1]
+    float GetAlpha() const;
+    // Transform of a body interpolated between the last two steps by GetAlpha(), for rendering
+    b2Transform GetRenderTransform(b2BodyId bodyId) const;
+    b2Vec2 GetRenderPosition(b2BodyId bodyId) const;
+    // Position of a body after the last step of the frame, for game logic
+    b2Vec2 GetPosition(b2BodyId bodyId) const;
+    // True when every body in the world was asleep after the last step of the frame
+    bool IsIdle() const;
+    // Timings (in ms) of the last step, e.g. to measure how stepping scales with the worker count
+    b2Profile GetProfile() const;
+    // Profiles and counters of the recent steps, with per-stage min/avg/p99
+    const PhysicsTelemetry& GetTelemetry() const;
+    void SetSubstepConfig(const PhysicsSubstepConfig& config);
+    // Substeps the next step will use
+    int GetSubstepCount() const;
+    // Applies to the softbodies created afterwards, existing ones keep their solver
+    void SetSoftBodySolver(PhysicsSoftBodySolver solver);
+    // Hash of the transform and velocities of every body created through Physics, in creation order, and of every mover's own velocity
+    uint64_t ComputeStateHash() const;
+    // enabled -> ComputeStateHash() is recorded into the state trace after every step
+    void SetStateTracing(bool enabled);
+    const PhysicsStateTrace& GetStateTrace() const;
+    // Enables every group parked by the previous configuration
+    void SetActivationConfig(const PhysicsActivationConfig& config);
+    // Parks the groups that got too far from focus and wakes up the cells that got close again
+    // cost follows the active groups and the cells around focus, not the size of the level
+    void UpdateActivation(b2Vec2 focus);
+    // Groups currently disabled because they are out of range
+    size_t GetParkedGroupCount() const;
+    // Takes the body out of the simulation, it keeps its shapes and joints so it can be enabled again
+    void DisableBody(b2BodyId bodyId);
+    // Puts a disabled body back into the simulation at position, at rest, and drops its undrained hits
+    void EnableBody(b2BodyId bodyId, b2Vec2 position);
+    // Copies transforms, velocities, sleep/enabled flags and joint parameters into snapshot,
+    // reusing its storage
+    void SaveSnapshot(PhysicsSnapshot& snapshot) const;
+    // Puts every body and joint back into the saved state; contacts are rebuilt by the next step
+    // returns false (and changes nothing) if bodies or joints were created since the snapshot was saved
+    bool RestoreSnapshot(const PhysicsSnapshot& snapshot);
+    // Queues a ray to be cast by the next CastQueuedRays
+    // pUserData -> reported as PhysicsHit::pUserDataA, e.g. the entity that fired
+    // category -> the ray only hits what a shape of this category would collide with
+    void QueueRayCast(b2Vec2 origin, b2Vec2 translation, void* pUserData, PhysicsCategory category = PHYSICS_CATEGORY_BULLET);
+    // Casts every queued ray against the world (in parallel on the task system, if any) and replaces
+    // the contents of hits with one PhysicsHit per ray that hit something, B being the closest body
+    void CastQueuedRays(std::vector<PhysicsHit>& hits);
+    // Hands over the hits gathered by the steps since the previous call
+    // the contents of hits are discarded and its storage is reused by the next steps
+    void DrainHits(std::vector<PhysicsHit>& hits);
+    // Spatial queries for gameplay (AI, spawning, area damage): results go into buffers owned by the
+    // caller and nothing is allocated; like every call that reads the world, they need a PhysicsWorldLock
+    // categoryMask -> PhysicsCategory bits of the shapes to report
+    // returns the number of results written, at most results.size()
+    size_t QueryAABB(b2AABB box, std::span<PhysicsQueryHit> results, uint64_t categoryMask = PHYSICS_QUERY_ALL_CATEGORIES) const;
+    // returns false if the ray hit nothing
+    bool CastRay(b2Vec2 origin, b2Vec2 translation, PhysicsQueryHit& hit, uint64_t categoryMask = PHYSICS_QUERY_ALL_CATEGORIES) const;
+    // proxy -> shape to sweep, see b2MakeProxy; returns false if it hit nothing
+    bool CastShape(
+        const b2ShapeProxy& proxy, b2Vec2 translation, PhysicsQueryHit& hit,
+        uint64_t categoryMask = PHYSICS_QUERY_ALL_CATEGORIES) const;
+    // The closest entities within radius, closest first: bodies with the same user data (e.g. the
+    // vertices of a softbody) count as one entity, reported by their closest shape
+    size_t FindNearest(
+        b2Vec2 position, float radius, std::span<PhysicsQueryHit> results,
+        uint64_t categoryMask = PHYSICS_QUERY_ALL_CATEGORIES) const;
+    // Runs a batch of queries (in parallel on the task system, if any)
+    void RunQueries(std::span<PhysicsQuery> queries) const;
+    // Pushes the dynamic shapes in range away from the position, parked bodies are left alone
+    // affected -> the entities with dynamic bodies within radius + falloff as by FindNearest, closest first,
+    // i.e. the ones that were pushed, e.g. for damage
+    // returns the number written
+    size_t Explode(const PhysicsExplosion& explosion, std::span<PhysicsQueryHit> affected);
+    PhysicsRigidBox CreateBox(b2Vec2 position, b2Vec2 size, bool dynamic = false, PhysicsCategory category = PHYSICS_CATEGORY_WALL);
+    // loops -> closed outlines, counter-clockwise around solid areas; chains are one-sided,
+    // so shapes only collide with them from the outside and slide over the joins without catching
+    PhysicsChainBody CreateChainBody(
+        const std::span<const std::vector<b2Vec2>>& loops, PhysicsCategory category = PHYSICS_CATEGORY_WALL);
+    // Character controller: a capsule on a kinematic body, moved before every step by b2World_CollideMover,
+    // b2SolvePlanes and b2World_CastMover instead of being simulated, so a velocity change shows on the next
+    // step and the character costs no solver constraints; it slides along walls, pushes dynamic bodies and is
+    // pushed back softly by them (PHYSICS_MOVER_DYNAMIC_PUSH_LIMIT), falls with the world's gravity and
+    // slows down by friction while on the ground
+    // capsule -> relative to position
+    // mass -> impulses given to ApplyMoverImpulse are divided by it
+    PhysicsMover CreateMover(
+        b2Vec2 position, const b2Capsule& capsule, float mass, PhysicsCategory category = PHYSICS_CATEGORY_PLAYER);
+    void ApplyMoverImpulse(const PhysicsMover& mover, b2Vec2 impulse);
+    b2Vec2 GetMoverVelocity(const PhysicsMover& mover) const;
+    // Turns the softbody into a visual layer of the mover: its vertices stop colliding and ignore gravity,
+    // and every step they are pulled towards their rest offsets around the mover; the joints keep it squishy
+    // restOffsets -> of each vertex from the mover's position
+    void AttachVisualSoftBody(
+        const PhysicsMover& mover, const PhysicsSoftBody& softBody, const std::span<const b2Vec2>& restOffsets);
+    // enableContactEvents -> report a PhysicsHit whenever the circle starts touching another shape
+    PhysicsRigidCircle CreateCircle(
+        b2Vec2 position, float radius, bool dynamic = false, bool enableContactEvents = false,
+        PhysicsCategory category = PHYSICS_CATEGORY_WALL);
     // vertices -> (of the softbody)
     // jointConns -> springs connecting pairs of vertices so that the body seems squishy
+    // the vertices of a softbody never collide with each other
     PhysicsSoftBody CreateSoftBody(
         b2Vec2 position,
+        const std::span<const b2Vec2>& vertices,
+        const std::span<const PhysicsSoftBodyJointConn>& jointConns,
+        PhysicsCategory category = PHYSICS_CATEGORY_WALL);
+    static PhysicsSoftBodyTemplate MakeSoftBodyTemplate(
         const std::span<const b2Vec2>& vertices,
         const std::span<const PhysicsSoftBodyJointConn>& jointConns);
+    PhysicsSoftBody CreateSoftBody(
+        b2Vec2 position,
+        const PhysicsSoftBodyTemplate& softBodyTemplate,
+        PhysicsCategory category = PHYSICS_CATEGORY_WALL);
+    // Instantiates one copy of the template at each position
+    std::vector<PhysicsSoftBody> CreateSoftBodies(
+        const std::span<const b2Vec2>& positions,
+        const PhysicsSoftBodyTemplate& softBodyTemplate,
+        PhysicsCategory category = PHYSICS_CATEGORY_WALL);
 private:
+    friend class PhysicsWorldLock;
+
+    struct RayCast {
+        b2Vec2 origin;
+        b2Vec2 translation;
+        void* pUserData;
+        PhysicsCategory category;
+    };
+
+    struct Mover {
+        b2BodyId bodyId;
+        b2Capsule capsule;
+        float mass;
+        PhysicsCategory category;
+        b2Vec2 velocity;
+        // Touched ground at the end of the last step, with that ground's normal
+        bool isGrounded;
+        b2Vec2 groundNormal;
+        // Vertices of the visual softbody and where they rest relative to the mover
+        std::vector<b2BodyId> followers;
+        std::vector<b2Vec2> followerOffsets;
+    };
+
+    // Bodies activated and deactivated together, stored in m_activationBodies
+    struct ActivationGroup {
+        uint32_t firstBody;
+        uint32_t bodyCount;
+        bool isParked;
+        // Cell the group was parked in
+        uint64_t cellKey;
+    };
+
     b2WorldId m_worldId;
+    TaskSystem* m_pTaskSystem;
+    float m_timestep;
+    float m_accumulator = 0.0f;
+    PhysicsSubstepConfig m_substepConfig = {
+        .minCount = PHYSICS_MIN_SUBSTEP_COUNT,
+        .maxCount = PHYSICS_MAX_SUBSTEP_COUNT,
+        .stepBudgetMs = PHYSICS_STEP_BUDGET_MS
+    };
+    int m_substepCount = PHYSICS_MAX_SUBSTEP_COUNT;
+    // Every body created through Physics
+    std::vector<b2BodyId> m_bodies;
+    // Every joint created through Physics
+    std::vector<b2JointId> m_joints;
+    // Transforms after the previous and the last step, indexed by b2BodyId::index1
+    // only bodies reported by box2d move events (or moved by Physics itself) are updated
+    std::vector<b2Transform> m_prevTransforms;
+    std::vector<b2Transform> m_currTransforms;
+    // Bodies that moved during the last step, their previous transform catches up on the next one
+    std::vector<b2BodyId> m_movedBodies;
+    // Indices whose transforms changed since the last publish, and those of the recent publishes
+    std::vector<uint32_t> m_changedIndices;
+    std::vector<uint32_t> m_publishedChanges[PHYSICS_FRAME_HISTORY];
+    uint64_t m_publishSerial = 0;
+    std::vector<PhysicsHit> m_hits;
+    std::vector<RayCast> m_rayCasts;
+    // One slot per queued ray, written by the cast tasks
+    std::vector<PhysicsHit> m_rayHits;
+    std::vector<uint8_t> m_rayHitFlags;
+    PhysicsTelemetry m_telemetry;
+    // False if box2d had allocated before the pool could be installed, its telemetry then records no allocations
+    bool m_countsAllocations = false;
+    bool m_stateTracing = false;
+    PhysicsStateTrace m_stateTrace;
+    PhysicsActivationConfig m_activationConfig = {};
+    std::vector<b2BodyId> m_activationBodies;
+    std::vector<ActivationGroup> m_activationGroups;
+    // Group of each body by b2BodyId::index1, -1 for bodies that are never parked (e.g. static ones)
+    std::vector<int> m_activationGroupOfBody;
+    // Groups not parked, checked on every UpdateActivation
+    std::vector<uint32_t> m_activeGroups;
+    // Parked groups by cell, only the cells around the focus are looked at
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_parkedCells;
+    PhysicsSoftBodySolver m_softBodySolver = PHYSICS_SOFTBODY_SOLVER_JOINTS;
+    // Negative group index given to the vertices of the next softbody, one per softbody
+    int m_nextSoftBodyGroup = -1;
+    std::unique_ptr<XpbdSolver> m_pXpbdSolver;
+    std::vector<Mover> m_movers;
+    TripleBuffer<PhysicsFrame> m_frames;
+    // Bodies were created or teleported since the last published frame
+    bool m_framePending = false;
+    // Game side copy of the latest frame
+    const PhysicsFrame* m_pFrame = nullptr;
+    float m_frameAlpha = 0.0f;
+    std::mutex m_worldMutex;
+    std::thread m_thread;
+    std::atomic<bool> m_threadStop = false;
+
+    void ThreadMain();
+    static void CastRayRange(int startIndex, int endIndex, uint32_t workerIndex, void* pContext);
+    static void RunQueryRange(int startIndex, int endIndex, uint32_t workerIndex, void* pContext);
+    void RunQuery(PhysicsQuery& query) const;
+    void Step();
+    void SolveMover(Mover& mover);
+    void PublishFrame();
+    void SyncMovedTransforms();
+    void SetTransformCache(b2BodyId bodyId, b2Transform transform);
+    void AdaptSubstepCount(const b2Profile& profile, const b2Counters& counters);
+    void GatherHits();
+    void RegisterBody(b2BodyId bodyId);
+    void RegisterActivationGroup(const std::span<const b2BodyId>& bodyIds);
+    void SetGroupParked(uint32_t groupIndex, bool isParked);
+    // DisableBody/EnableBody take over: the group leaves its cell without being enabled
+    void ForgetParkedGroup(b2BodyId bodyId);
+    uint64_t GetCellKey(b2Vec2 position) const;
 };
 
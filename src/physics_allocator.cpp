@@ -0,0 +1,128 @@
+#include "physics_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include "box2d/box2d.h"
+
+static void* AllocateForBox2d(unsigned int size, int alignment) {
+    return PhysicsAllocator::GetInstance().Allocate(size, (size_t)alignment);
+}
+
+static void FreeForBox2d(void* pMemory) {
+    PhysicsAllocator::GetInstance().Free(pMemory);
+}
+
+PhysicsAllocator::~PhysicsAllocator() {
+    for (void* pChunk : m_chunks) {
+        ::operator delete(pChunk, std::align_val_t(PHYSICS_ALLOCATOR_ALIGNMENT));
+    }
+}
+
+PhysicsAllocator& PhysicsAllocator::GetInstance() {
+    static PhysicsAllocator instance;
+    return instance;
+}
+
+bool PhysicsAllocator::Install() {
+    std::lock_guard lock(m_mutex);
+    if (m_isInstalled)
+        return true;
+    // Memory box2d already got from its own allocator would be freed here
+    if (b2GetByteCount() != 0)
+        return false;
+    b2SetAllocator(AllocateForBox2d, FreeForBox2d);
+    m_isInstalled = true;
+    return true;
+}
+
+bool PhysicsAllocator::IsInstalled() const {
+    std::lock_guard lock(m_mutex);
+    return m_isInstalled;
+}
+
+void* PhysicsAllocator::Allocate(size_t size, size_t alignment) {
+    assert(alignment <= PHYSICS_ALLOCATOR_ALIGNMENT);
+    size_t offset = std::max(alignment, sizeof(Header));
+    size_t blockSize = offset + size;
+    int sizeClass = 0;
+    while (sizeClass < PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT && GetSizeClassBytes(sizeClass) < blockSize) {
+        sizeClass++;
+    }
+
+    std::lock_guard lock(m_mutex);
+    uint8_t* pBlock;
+    if (sizeClass < PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT) {
+        if (m_freeLists[sizeClass] == nullptr) {
+            uint8_t* pChunk = static_cast<uint8_t*>(
+                ::operator new(PHYSICS_ALLOCATOR_CHUNK_SIZE, std::align_val_t(PHYSICS_ALLOCATOR_ALIGNMENT)));
+            m_chunks.push_back(pChunk);
+            m_stats.reservedBytes += PHYSICS_ALLOCATOR_CHUNK_SIZE;
+            m_stats.systemAllocationCount++;
+            size_t classBytes = GetSizeClassBytes(sizeClass);
+            for (size_t i = PHYSICS_ALLOCATOR_CHUNK_SIZE / classBytes; i > 0; i--) {
+                FreeBlock* pFree = reinterpret_cast<FreeBlock*>(pChunk + (i - 1) * classBytes);
+                pFree->pNext = m_freeLists[sizeClass];
+                m_freeLists[sizeClass] = pFree;
+            }
+        }
+        pBlock = reinterpret_cast<uint8_t*>(m_freeLists[sizeClass]);
+        m_freeLists[sizeClass] = m_freeLists[sizeClass]->pNext;
+    }
+    else {
+        pBlock = static_cast<uint8_t*>(::operator new(blockSize, std::align_val_t(PHYSICS_ALLOCATOR_ALIGNMENT)));
+        m_stats.reservedBytes += blockSize;
+        m_stats.systemAllocationCount++;
+    }
+
+    uint8_t* pMemory = pBlock + offset;
+    Header* pHeader = reinterpret_cast<Header*>(pMemory) - 1;
+    pHeader->size = size;
+    pHeader->sizeClass = (uint32_t)sizeClass;
+    pHeader->offset = (uint32_t)offset;
+
+    m_stats.allocationCount++;
+    m_stats.bytesInUse += size;
+    m_stats.peakBytesInUse = std::max(m_stats.peakBytesInUse, m_stats.bytesInUse);
+    m_stats.bytesBySizeClass[sizeClass] += size;
+    m_stats.allocationsBySizeClass[sizeClass]++;
+    m_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return pMemory;
+}
+
+void PhysicsAllocator::Free(void* pMemory) {
+    if (pMemory == nullptr)
+        return;
+    const Header* pHeader = static_cast<const Header*>(pMemory) - 1;
+    size_t size = pHeader->size;
+    int sizeClass = (int)pHeader->sizeClass;
+    uint8_t* pBlock = static_cast<uint8_t*>(pMemory) - pHeader->offset;
+
+    std::lock_guard lock(m_mutex);
+    m_stats.bytesInUse -= size;
+    m_stats.bytesBySizeClass[sizeClass] -= size;
+    if (sizeClass < PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT) {
+        FreeBlock* pFree = reinterpret_cast<FreeBlock*>(pBlock);
+        pFree->pNext = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = pFree;
+    }
+    else {
+        m_stats.reservedBytes -= pHeader->offset + size;
+        ::operator delete(pBlock, std::align_val_t(PHYSICS_ALLOCATOR_ALIGNMENT));
+    }
+}
+
+PhysicsAllocatorStats PhysicsAllocator::GetStats() const {
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+uint64_t PhysicsAllocator::GetAllocationCount() const {
+    return m_allocationCount.load(std::memory_order_relaxed);
+}
+
+size_t PhysicsAllocator::GetSizeClassBytes(int sizeClass) {
+    if (sizeClass >= PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT)
+        return 0;
+    return (size_t)1 << (PHYSICS_ALLOCATOR_MIN_BLOCK_SHIFT + sizeClass);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum {
+    // Size classes are powers of two from 64 bytes (1 << 6) to 64 KiB, larger blocks come from the system
+    PHYSICS_ALLOCATOR_MIN_BLOCK_SHIFT = 6,
+    PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT = 11,
+    // Blocks of a size class are carved from chunks of this size
+    PHYSICS_ALLOCATOR_CHUNK_SIZE = 256 * 1024,
+    // Of every block, box2d asks for less
+    PHYSICS_ALLOCATOR_ALIGNMENT = 64
+};
+
+struct PhysicsAllocatorStats {
+    // Bytes requested by box2d that are currently allocated, and the most there ever were
+    size_t bytesInUse;
+    size_t peakBytesInUse;
+    // Taken from the system: chunks plus the blocks too large for any size class
+    size_t reservedBytes;
+    uint64_t allocationCount;
+    uint64_t systemAllocationCount;
+    // By size class, the last entry is for blocks too large for any of them
+    size_t bytesBySizeClass[PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT + 1];
+    uint64_t allocationsBySizeClass[PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT + 1];
+};
+
+// Size-class pool behind box2d's b2SetAllocator hooks: freed blocks go back to the free list of their
+// class and are reused, so bodies and joints created and destroyed during play don't reach the system
+// allocator once the pools have grown; chunks are only returned on exit
+// box2d allocates from whichever thread steps a world, so every call takes a lock
+class PhysicsAllocator {
+public:
+    PhysicsAllocator(const PhysicsAllocator&) = delete;
+    ~PhysicsAllocator();
+    static PhysicsAllocator& GetInstance();
+    // Must happen before box2d allocates anything, otherwise returns false and leaves box2d's allocator in place
+    bool Install();
+    bool IsInstalled() const;
+    // alignment -> at most PHYSICS_ALLOCATOR_ALIGNMENT
+    void* Allocate(size_t size, size_t alignment);
+    void Free(void* pMemory);
+    PhysicsAllocatorStats GetStats() const;
+    // Allocations so far, without taking the lock
+    uint64_t GetAllocationCount() const;
+    // sizeClass -> PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT for the large blocks, which returns 0
+    static size_t GetSizeClassBytes(int sizeClass);
+private:
+    PhysicsAllocator() {};
+
+    struct FreeBlock {
+        FreeBlock* pNext;
+    };
+    // Right in front of the memory handed out, so Free can find its block and size class
+    struct Header {
+        uint64_t size;
+        uint32_t sizeClass;
+        // From the start of the block to the memory handed out
+        uint32_t offset;
+    };
+
+    mutable std::mutex m_mutex;
+    FreeBlock* m_freeLists[PHYSICS_ALLOCATOR_SIZE_CLASS_COUNT] = {};
+    std::vector<void*> m_chunks;
+    PhysicsAllocatorStats m_stats = {};
+    std::atomic<uint64_t> m_allocationCount = 0;
+    bool m_isInstalled = false;
+};
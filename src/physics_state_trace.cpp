@@ -0,0 +1,79 @@
+#include "physics_state_trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iomanip>
+
+// xxHash64 primes
+static constexpr uint64_t g_prime1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t g_prime2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t g_prime3 = 0x165667B19E3779F9ull;
+
+void PhysicsStateHasher::Add(uint64_t value) {
+    m_acc ^= std::rotl(value * g_prime2, 31) * g_prime1;
+    m_acc = std::rotl(m_acc, 27) * g_prime1 + g_prime3;
+    m_length++;
+}
+
+void PhysicsStateHasher::Add(float value) {
+    Add((uint64_t)std::bit_cast<uint32_t>(value));
+}
+
+uint64_t PhysicsStateHasher::Finish() const {
+    uint64_t hash = m_acc + m_length;
+    hash ^= hash >> 33;
+    hash *= g_prime2;
+    hash ^= hash >> 29;
+    hash *= g_prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void PhysicsStateTrace::Record(uint64_t hash) {
+    m_hashes.push_back(hash);
+}
+
+void PhysicsStateTrace::Clear() {
+    m_hashes.clear();
+}
+
+size_t PhysicsStateTrace::GetStepCount() const {
+    return m_hashes.size();
+}
+
+uint64_t PhysicsStateTrace::GetHash(size_t step) const {
+    return m_hashes[step];
+}
+
+int64_t PhysicsStateTrace::FindDivergence(const PhysicsStateTrace& reference) const {
+    size_t stepCount = std::min(m_hashes.size(), reference.m_hashes.size());
+    for (size_t i = 0; i < stepCount; i++) {
+        if (m_hashes[i] != reference.m_hashes[i])
+            return (int64_t)i;
+    }
+    return -1;
+}
+
+bool PhysicsStateTrace::Save(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    file << std::hex << std::setfill('0');
+    for (uint64_t hash : m_hashes) {
+        file << std::setw(16) << hash << '\n';
+    }
+    return (bool)file;
+}
+
+bool PhysicsStateTrace::Load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    m_hashes.clear();
+    uint64_t hash;
+    while (file >> std::hex >> hash) {
+        m_hashes.push_back(hash);
+    }
+    return file.eof();
+}
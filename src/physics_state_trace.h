@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Streaming 64-bit hash in the style of xxHash64: every value goes through a multiply-rotate round,
+// the result is avalanched at the end; floats are hashed by their bits, so any difference shows
+class PhysicsStateHasher {
+public:
+    void Add(uint64_t value);
+    void Add(float value);
+    uint64_t Finish() const;
+private:
+    uint64_t m_acc = 0x27D4EB2F165667C5ull;
+    uint64_t m_length = 0;
+};
+
+// Hash of the world state after every step, to find the first step at which two runs diverge
+class PhysicsStateTrace {
+public:
+    void Record(uint64_t hash);
+    void Clear();
+    size_t GetStepCount() const;
+    uint64_t GetHash(size_t step) const;
+    // returns the first step whose hash differs from reference's, or -1 if they match over the steps
+    // both traces have
+    int64_t FindDivergence(const PhysicsStateTrace& reference) const;
+    // One hexadecimal hash per line, oldest step first
+    bool Save(const std::string& path) const;
+    // returns false if the file could not be read or is malformed
+    bool Load(const std::string& path);
+private:
+    std::vector<uint64_t> m_hashes;
+};
@@ -0,0 +1,111 @@
+#include "physics_telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+struct PhysicsTelemetryStageInfo {
+    const char* pName;
+    float b2Profile::* pField;
+};
+
+// bullets -> continuous collision of fast bodies
+static const PhysicsTelemetryStageInfo g_stages[PHYSICS_TELEMETRY_STAGE_COUNT] = {
+    { "step",             &b2Profile::step },
+    { "pairs",            &b2Profile::pairs },
+    { "collide",          &b2Profile::collide },
+    { "solve",            &b2Profile::solve },
+    { "solveConstraints", &b2Profile::solveConstraints },
+    { "transforms",       &b2Profile::transforms },
+    { "refit",            &b2Profile::refit },
+    { "continuous",       &b2Profile::bullets },
+    { "sleepIslands",     &b2Profile::sleepIslands },
+    { "sensors",          &b2Profile::sensors }
+};
+
+PhysicsTelemetry::PhysicsTelemetry(size_t capacity)
+    : m_samples(std::max(capacity, (size_t)1))
+{}
+
+void PhysicsTelemetry::Record(int substepCount, const b2Profile& profile, const b2Counters& counters, uint64_t allocationCount) {
+    m_samples[m_next] = PhysicsTelemetrySample{
+        .stepIndex = m_stepIndex++,
+        .substepCount = substepCount,
+        .profile = profile,
+        .counters = counters,
+        .allocationCount = allocationCount
+    };
+    m_next = (m_next + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+void PhysicsTelemetry::Clear() {
+    m_next = 0;
+    m_count = 0;
+}
+
+size_t PhysicsTelemetry::GetSampleCount() const {
+    return m_count;
+}
+
+const PhysicsTelemetrySample& PhysicsTelemetry::GetSample(size_t index) const {
+    size_t oldest = (m_next + m_samples.size() - m_count) % m_samples.size();
+    return m_samples[(oldest + index) % m_samples.size()];
+}
+
+PhysicsTelemetryStat PhysicsTelemetry::GetStat(PhysicsTelemetryStage stage) const {
+    if (m_count == 0)
+        return PhysicsTelemetryStat{};
+
+    std::vector<float> values(m_count);
+    float sum = 0.0f;
+    for (size_t i = 0; i < m_count; i++) {
+        values[i] = GetSample(i).profile.*g_stages[stage].pField;
+        sum += values[i];
+    }
+    auto [pMin, pMax] = std::minmax_element(values.begin(), values.end());
+    PhysicsTelemetryStat stat = {
+        .min = *pMin,
+        .avg = sum / m_count,
+        .p99 = 0.0f,
+        .max = *pMax
+    };
+    // Nearest rank
+    size_t rank = (size_t)std::ceil(0.99 * m_count) - 1;
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    stat.p99 = values[rank];
+    return stat;
+}
+
+const char* PhysicsTelemetry::GetStageName(PhysicsTelemetryStage stage) {
+    return g_stages[stage].pName;
+}
+
+void PhysicsTelemetry::WriteCsv(std::ostream& out) const {
+    out << "stepIndex,substepCount";
+    for (const auto& stage : g_stages) {
+        out << ',' << stage.pName;
+    }
+    out << ",bodyCount,shapeCount,contactCount,jointCount,islandCount,staticTreeHeight,treeHeight,processAllocations\n";
+
+    for (size_t i = 0; i < m_count; i++) {
+        const PhysicsTelemetrySample& sample = GetSample(i);
+        out << sample.stepIndex << ',' << sample.substepCount;
+        for (const auto& stage : g_stages) {
+            out << ',' << sample.profile.*stage.pField;
+        }
+        const b2Counters& counters = sample.counters;
+        out << ',' << counters.bodyCount << ',' << counters.shapeCount
+            << ',' << counters.contactCount << ',' << counters.jointCount
+            << ',' << counters.islandCount << ',' << counters.staticTreeHeight
+            << ',' << counters.treeHeight << ',' << sample.allocationCount << '\n';
+    }
+}
+
+bool PhysicsTelemetry::ExportCsv(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    WriteCsv(file);
+    return (bool)file;
+}
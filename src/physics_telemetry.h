@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "box2d/box2d.h"
+
+enum {
+    // 10 seconds of steps at 60 Hz
+    PHYSICS_TELEMETRY_CAPACITY = 600
+};
+
+// Stages of b2Profile that get aggregated
+enum PhysicsTelemetryStage {
+    PHYSICS_TELEMETRY_STEP,
+    PHYSICS_TELEMETRY_PAIRS,
+    PHYSICS_TELEMETRY_COLLIDE,
+    PHYSICS_TELEMETRY_SOLVE,
+    PHYSICS_TELEMETRY_SOLVE_CONSTRAINTS,
+    PHYSICS_TELEMETRY_TRANSFORMS,
+    PHYSICS_TELEMETRY_REFIT,
+    PHYSICS_TELEMETRY_CONTINUOUS,
+    PHYSICS_TELEMETRY_SLEEP_ISLANDS,
+    PHYSICS_TELEMETRY_SENSORS,
+    PHYSICS_TELEMETRY_STAGE_COUNT
+};
+
+// Everything recorded after one world step
+struct PhysicsTelemetrySample {
+    uint64_t stepIndex;
+    int substepCount;
+    b2Profile profile;
+    b2Counters counters;
+    // box2d allocations made in the whole process during the step, so including those of other worlds stepping at once;
+    // 0 if PhysicsAllocator is not installed
+    uint64_t allocationCount;
+};
+
+// Aggregate of one stage over the samples in the ring buffer, in ms
+struct PhysicsTelemetryStat {
+    float min;
+    float avg;
+    float p99;
+    float max;
+};
+
+// Rolling history of per-step profiles and counters
+class PhysicsTelemetry {
+public:
+    PhysicsTelemetry(size_t capacity = PHYSICS_TELEMETRY_CAPACITY);
+    // Overwrites the oldest sample once the buffer is full
+    void Record(int substepCount, const b2Profile& profile, const b2Counters& counters, uint64_t allocationCount);
+    void Clear();
+    size_t GetSampleCount() const;
+    // index -> 0 is the oldest sample, GetSampleCount() - 1 the latest
+    const PhysicsTelemetrySample& GetSample(size_t index) const;
+    PhysicsTelemetryStat GetStat(PhysicsTelemetryStage stage) const;
+    static const char* GetStageName(PhysicsTelemetryStage stage);
+    // One row per sample, oldest first: step index, substeps, every stage (ms), counts, tree heights and allocations
+    void WriteCsv(std::ostream& out) const;
+    // returns false if the file could not be written
+    bool ExportCsv(const std::string& path) const;
+private:
+    std::vector<PhysicsTelemetrySample> m_samples;
+    size_t m_next = 0;
+    size_t m_count = 0;
+    uint64_t m_stepIndex = 0;
+};
@@ -0,0 +1,61 @@
+#include "physics_world_group.h"
+
+#include <algorithm>
+#include <chrono>
+
+PhysicsWorldGroup::PhysicsWorldGroup(TaskSystem& taskSystem)
+    : m_taskSystemRef(taskSystem)
+{}
+
+size_t PhysicsWorldGroup::Add(Physics& physics) {
+    m_worlds.push_back(World{ .pPhysics = &physics, .timing = {} });
+    m_order.push_back(m_worlds.size() - 1);
+    return m_worlds.size() - 1;
+}
+
+size_t PhysicsWorldGroup::GetWorldCount() const {
+    return m_worlds.size();
+}
+
+Physics& PhysicsWorldGroup::GetWorld(size_t index) {
+    return *m_worlds[index].pPhysics;
+}
+
+void PhysicsWorldGroup::Update(float elapsed) {
+    if (m_worlds.empty())
+        return;
+
+    // Longest processing time first: the last costs are a good guess of the next ones
+    std::sort(m_order.begin(), m_order.end(), [this](size_t a, size_t b) {
+        return m_worlds[a].timing.lastMs > m_worlds[b].timing.lastMs;
+    });
+    m_elapsed = elapsed;
+    m_nextWorld.store(0, std::memory_order_relaxed);
+
+    // One range per worker, each of them pulls worlds from the shared queue until it is empty
+    int laneCount = std::min(m_taskSystemRef.GetWorkerCount(), (int)m_worlds.size());
+    m_taskSystemRef.Wait(m_taskSystemRef.Submit(UpdateWorlds, laneCount, 1, this));
+}
+
+void PhysicsWorldGroup::UpdateWorlds(int startIndex, int endIndex, uint32_t, void* pContext) {
+    PhysicsWorldGroup& group = *static_cast<PhysicsWorldGroup*>(pContext);
+    for (int lane = startIndex; lane < endIndex; lane++) {
+        size_t next;
+        while ((next = group.m_nextWorld.fetch_add(1, std::memory_order_relaxed)) < group.m_order.size()) {
+            World& world = group.m_worlds[group.m_order[next]];
+            auto start = std::chrono::steady_clock::now();
+            world.pPhysics->Update(group.m_elapsed);
+            float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            PhysicsWorldTiming& timing = world.timing;
+            timing.updateCount++;
+            timing.lastMs = ms;
+            timing.avgMs += (ms - timing.avgMs) / timing.updateCount;
+            timing.maxMs = std::max(timing.maxMs, ms);
+        }
+    }
+}
+
+PhysicsWorldTiming PhysicsWorldGroup::GetTiming(size_t index) const {
+    return m_worlds[index].timing;
+}
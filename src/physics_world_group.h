@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "physics.h"
+#include "task_system.h"
+
+// Step cost of one world, in ms of wall time spent in its Physics::Update
+struct PhysicsWorldTiming {
+    float lastMs;
+    float avgMs;
+    float maxMs;
+    unsigned long long updateCount;
+};
+
+// Independent worlds (rooms, matches...) updated concurrently on one TaskSystem
+// every worker takes the most expensive world left (by the cost of its previous update),
+// so a few heavy worlds don't end up queued behind each other on the same worker
+class PhysicsWorldGroup {
+public:
+    PhysicsWorldGroup(TaskSystem& taskSystem);
+    PhysicsWorldGroup(const PhysicsWorldGroup&) = delete;
+    // physics -> not owned, must outlive the group; it should be created without a TaskSystem
+    //            since the parallelism comes from stepping many worlds at once
+    // returns the index of the world in the group
+    size_t Add(Physics& physics);
+    size_t GetWorldCount() const;
+    Physics& GetWorld(size_t index);
+    // Calls Update(elapsed) on every world and returns when all of them are done
+    void Update(float elapsed);
+    PhysicsWorldTiming GetTiming(size_t index) const;
+private:
+    struct World {
+        Physics* pPhysics;
+        PhysicsWorldTiming timing;
+    };
+
+    TaskSystem& m_taskSystemRef;
+    std::vector<World> m_worlds;
+    // Indices into m_worlds, most expensive first
+    std::vector<size_t> m_order;
+    std::atomic<size_t> m_nextWorld = 0;
+    float m_elapsed = 0.0f;
+
+    static void UpdateWorlds(int startIndex, int endIndex, uint32_t workerIndex, void* pContext);
+};
@@ -19,15 +19,23 @@ SDL_Window* Platform::GetWindowHandle() const {
     return m_pWindow;
 }
 
-void Platform::HandleEvents() {
+bool Platform::HandleEvents() {
+    bool hadEvents = false;
     SDL_Event evt;
     while (SDL_PollEvent(&evt)) {
+        hadEvents = true;
         switch (evt.type) {
             case SDL_EVENT_QUIT:
                 m_shouldClose = true;
                 break;
         }
     }
+    return hadEvents;
+}
+
+bool Platform::WaitEvents(int timeoutMs) {
+    // Only wait for the event, it is left in the queue for the next HandleEvents
+    return SDL_WaitEventTimeout(nullptr, timeoutMs);
 }
 
 bool Platform::WindowShouldClose() const {
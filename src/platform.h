@@ -27,7 +27,11 @@ public:
     Platform();
     ~Platform();
     SDL_Window* GetWindowHandle() const;
-    void HandleEvents();
+    // Returns true if any event was processed
+    bool HandleEvents();
+    // Blocks until an event arrives or timeoutMs passes, returns true if one is pending
+    // the event stays queued, HandleEvents is the only place that consumes events
+    bool WaitEvents(int timeoutMs);
     bool WindowShouldClose() const;
     void GetMousePosition(float* pX, float* pY, bool* clickIsPressed);
     void GetWindowSize(int* pWidth, int* pHeight);
@@ -93,7 +93,7 @@ void Renderer::RenderScene() {
     // Create transfer buffer with vertex data
     SDL_GPUTransferBufferCreateInfo transferBufferCreateInfo = {
         .usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD,
-        .size  = (Uint32)(m_triangles.size() * sizeof(RendererTriangle)),
+        .size  = (Uint32)(m_triangleCount * sizeof(RendererTriangle)),
         .props = 0
     };
     SDL_GPUTransferBuffer* pTransferBuffer = SDL_CreateGPUTransferBuffer(m_pDevice, &transferBufferCreateInfo);
@@ -147,17 +147,27 @@ void Renderer::RenderScene() {
         .offset = 0
     };
     SDL_BindGPUVertexBuffers(pRenderPass, 0, &bufferBinding, 1);
-    SDL_DrawGPUPrimitives(pRenderPass, m_triangles.size() * 3, 1, 0, 0);
+    SDL_DrawGPUPrimitives(pRenderPass, m_triangleCount * 3, 1, 0, 0);
     SDL_EndGPURenderPass(pRenderPass);
 
     SDL_SubmitGPUCommandBuffer(pCommandBuffer);
     SDL_ReleaseGPUTransferBuffer(m_pDevice, pTransferBuffer);
 
-    m_triangles.clear();
+    // Keep the storage, the next frame overwrites it
+    m_triangleCount = 0;
 }
 
 void Renderer::PushTriangle(const RendererTriangle& triangle) {
-    m_triangles.push_back(triangle);
+    ReserveTriangles(1)[0] = triangle;
+}
+
+std::span<RendererTriangle> Renderer::ReserveTriangles(size_t count) {
+    size_t first = m_triangleCount;
+    m_triangleCount += count;
+    // Only storage beyond the largest batch so far is initialized, steady-state frames write straight into it
+    if (m_triangleCount > m_triangles.size())
+        m_triangles.resize(m_triangleCount);
+    return std::span<RendererTriangle>(m_triangles.data() + first, count);
 }
 
 SDL_GPUShader* Renderer::LoadShader(const std::string& path, ShaderStage shaderStage, Uint32 num_samplers, Uint32 num_uniform_buffers) {
@@ -61,9 +61,14 @@ public:
     static Renderer& GetInstance();
     void RenderScene();
     void PushTriangle(const RendererTriangle& triangle);
+    // Appends count triangles to the batch and returns them for in-place writes
+    // the span is only valid until the next push/reserve or RenderScene()
+    std::span<RendererTriangle> ReserveTriangles(size_t count);
 private:
     Renderer() {};
+    // Grows to the largest batch and is reused, only the first m_triangleCount are this frame's
     std::vector<RendererTriangle> m_triangles;
+    size_t m_triangleCount = 0;
     glm::mat4 m_projection;
     SDL_Window* m_pWindow;
     SDL_GPUDevice* m_pDevice;
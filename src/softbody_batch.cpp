@@ -0,0 +1,170 @@
+#include "softbody_batch.h"
+
+#include "SDL3/SDL.h"
+#include "SDL3/SDL_intrin.h"
+
+// Texture coordinates of each softbody vertex, the center is always at (0.5, 0.5)
+constexpr float g_softbodyU[SOFTBODY_VERTEX_COUNT] = { 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f };
+constexpr float g_softbodyV[SOFTBODY_VERTEX_COUNT] = { 1.0f, 1.0f, 0.5f, 0.0f, 0.0f, 0.5f };
+constexpr float g_invVertexCount = 1.0f / (float)SOFTBODY_VERTEX_COUNT;
+
+static void BuildScalar(const SoftbodyPositions& positions, size_t first, RendererTriangle* pTriangles) {
+    for (size_t b = first; b < positions.count; b++) {
+        float centerX = 0.0f, centerY = 0.0f;
+        for (int v = 0; v < SOFTBODY_VERTEX_COUNT; v++) {
+            centerX += positions.pX[v][b];
+            centerY += positions.pY[v][b];
+        }
+        centerX *= g_invVertexCount;
+        centerY *= g_invVertexCount;
+
+        unsigned int texIdx = positions.pTexIdx[b];
+        RendererTriangle* pOut = pTriangles + b * SOFTBODY_VERTEX_COUNT;
+        for (int i = 0; i < SOFTBODY_VERTEX_COUNT; i++) {
+            int next = (i + 1) % SOFTBODY_VERTEX_COUNT;
+            pOut[i].points[0] = RendererVertex{ .x = positions.pX[i][b],    .y = positions.pY[i][b],    .u = g_softbodyU[i],    .v = g_softbodyV[i],    .texIdx = texIdx };
+            pOut[i].points[1] = RendererVertex{ .x = positions.pX[next][b], .y = positions.pY[next][b], .u = g_softbodyU[next], .v = g_softbodyV[next], .texIdx = texIdx };
+            pOut[i].points[2] = RendererVertex{ .x = centerX,               .y = centerY,               .u = 0.5f,              .v = 0.5f,              .texIdx = texIdx };
+        }
+    }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+// Writes one point of the same triangle for 4 consecutive softbodies
+// x/y hold one lane per softbody; each vertex gets a single 16 byte store of (x, y, u, v)
+static inline SDL_TARGETING("sse2") void StorePoints4(
+    RendererTriangle* pTriangles, int triangle, int point,
+    __m128 x, __m128 y, float u, float v, const unsigned int* pTexIdx
+) {
+    __m128 uv = _mm_setr_ps(u, v, u, v);
+    __m128 xy01 = _mm_unpacklo_ps(x, y);
+    __m128 xy23 = _mm_unpackhi_ps(x, y);
+    __m128 lanes[4] = {
+        _mm_movelh_ps(xy01, uv),
+        _mm_movehl_ps(uv, xy01),
+        _mm_movelh_ps(xy23, uv),
+        _mm_movehl_ps(uv, xy23)
+    };
+    for (int j = 0; j < 4; j++) {
+        RendererVertex& vertex = pTriangles[j * SOFTBODY_VERTEX_COUNT + triangle].points[point];
+        _mm_storeu_ps(&vertex.x, lanes[j]);
+        vertex.texIdx = pTexIdx[j];
+    }
+}
+
+// Emits the triangle fans of 4 consecutive softbodies
+static inline SDL_TARGETING("sse2") void StoreFans4(
+    RendererTriangle* pTriangles, const __m128* pX, const __m128* pY,
+    __m128 centerX, __m128 centerY, const unsigned int* pTexIdx
+) {
+    for (int i = 0; i < SOFTBODY_VERTEX_COUNT; i++) {
+        int next = (i + 1) % SOFTBODY_VERTEX_COUNT;
+        StorePoints4(pTriangles, i, 0, pX[i],    pY[i],    g_softbodyU[i],    g_softbodyV[i],    pTexIdx);
+        StorePoints4(pTriangles, i, 1, pX[next], pY[next], g_softbodyU[next], g_softbodyV[next], pTexIdx);
+        StorePoints4(pTriangles, i, 2, centerX,  centerY,  0.5f,              0.5f,              pTexIdx);
+    }
+}
+
+// Returns the index of the first softbody left unprocessed
+static SDL_TARGETING("sse2") size_t BuildSSE2(const SoftbodyPositions& positions, size_t first, RendererTriangle* pTriangles) {
+    const __m128 invCount = _mm_set1_ps(g_invVertexCount);
+    size_t b = first;
+    for (; b + 4 <= positions.count; b += 4) {
+        __m128 x[SOFTBODY_VERTEX_COUNT], y[SOFTBODY_VERTEX_COUNT];
+        __m128 centerX = _mm_setzero_ps(), centerY = _mm_setzero_ps();
+        for (int v = 0; v < SOFTBODY_VERTEX_COUNT; v++) {
+            x[v] = _mm_loadu_ps(positions.pX[v] + b);
+            y[v] = _mm_loadu_ps(positions.pY[v] + b);
+            centerX = _mm_add_ps(centerX, x[v]);
+            centerY = _mm_add_ps(centerY, y[v]);
+        }
+        centerX = _mm_mul_ps(centerX, invCount);
+        centerY = _mm_mul_ps(centerY, invCount);
+        StoreFans4(pTriangles + b * SOFTBODY_VERTEX_COUNT, x, y, centerX, centerY, positions.pTexIdx + b);
+    }
+    return b;
+}
+#endif
+
+#if defined(SDL_AVX2_INTRINSICS) && defined(SDL_SSE2_INTRINSICS)
+// Centroids are computed 8 softbodies at a time, the fans are stored as two blocks of 4
+static SDL_TARGETING("avx2") size_t BuildAVX2(const SoftbodyPositions& positions, size_t first, RendererTriangle* pTriangles) {
+    const __m256 invCount = _mm256_set1_ps(g_invVertexCount);
+    size_t b = first;
+    for (; b + 8 <= positions.count; b += 8) {
+        __m128 xLo[SOFTBODY_VERTEX_COUNT], yLo[SOFTBODY_VERTEX_COUNT];
+        __m128 xHi[SOFTBODY_VERTEX_COUNT], yHi[SOFTBODY_VERTEX_COUNT];
+        __m256 centerX = _mm256_setzero_ps(), centerY = _mm256_setzero_ps();
+        for (int v = 0; v < SOFTBODY_VERTEX_COUNT; v++) {
+            __m256 x = _mm256_loadu_ps(positions.pX[v] + b);
+            __m256 y = _mm256_loadu_ps(positions.pY[v] + b);
+            centerX = _mm256_add_ps(centerX, x);
+            centerY = _mm256_add_ps(centerY, y);
+            xLo[v] = _mm256_castps256_ps128(x);
+            yLo[v] = _mm256_castps256_ps128(y);
+            xHi[v] = _mm256_extractf128_ps(x, 1);
+            yHi[v] = _mm256_extractf128_ps(y, 1);
+        }
+        centerX = _mm256_mul_ps(centerX, invCount);
+        centerY = _mm256_mul_ps(centerY, invCount);
+        StoreFans4(pTriangles + b * SOFTBODY_VERTEX_COUNT, xLo, yLo,
+            _mm256_castps256_ps128(centerX), _mm256_castps256_ps128(centerY), positions.pTexIdx + b);
+        StoreFans4(pTriangles + (b + 4) * SOFTBODY_VERTEX_COUNT, xHi, yHi,
+            _mm256_extractf128_ps(centerX, 1), _mm256_extractf128_ps(centerY, 1), positions.pTexIdx + b + 4);
+    }
+    _mm256_zeroupper();
+    return b;
+}
+#endif
+
+void BuildSoftbodyTriangles(const SoftbodyPositions& positions, RendererTriangle* pTriangles) {
+    size_t first = 0;
+#if defined(SDL_AVX2_INTRINSICS) && defined(SDL_SSE2_INTRINSICS)
+    static const bool hasAVX2 = SDL_HasAVX2();
+    if (hasAVX2)
+        first = BuildAVX2(positions, first, pTriangles);
+#endif
+#ifdef SDL_SSE2_INTRINSICS
+    static const bool hasSSE2 = SDL_HasSSE2();
+    if (hasSSE2)
+        first = BuildSSE2(positions, first, pTriangles);
+#endif
+    BuildScalar(positions, first, pTriangles);
+}
+
+SoftbodyBatch& SoftbodyBatch::GetInstance() {
+    static SoftbodyBatch instance;
+    return instance;
+}
+
+void SoftbodyBatch::Push(const Physics& physics, const PhysicsSoftBody& softbody, unsigned int texIdx) {
+    for (int v = 0; v < SOFTBODY_VERTEX_COUNT; v++) {
+        b2Vec2 position = physics.GetRenderPosition(softbody.vertices[v].Id);
+        m_x[v].push_back(position.x);
+        m_y[v].push_back(position.y);
+    }
+    m_texIdx.push_back(texIdx);
+}
+
+void SoftbodyBatch::Flush() {
+    if (m_texIdx.empty())
+        return;
+
+    SoftbodyPositions positions;
+    for (int v = 0; v < SOFTBODY_VERTEX_COUNT; v++) {
+        positions.pX[v] = m_x[v].data();
+        positions.pY[v] = m_y[v].data();
+    }
+    positions.pTexIdx = m_texIdx.data();
+    positions.count = m_texIdx.size();
+
+    std::span<RendererTriangle> triangles =
+        Renderer::GetInstance().ReserveTriangles(positions.count * SOFTBODY_VERTEX_COUNT);
+    BuildSoftbodyTriangles(positions, triangles.data());
+
+    for (int v = 0; v < SOFTBODY_VERTEX_COUNT; v++) {
+        m_x[v].clear();
+        m_y[v].clear();
+    }
+    m_texIdx.clear();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <array>
+#include <vector>
+#include "physics.h"
+#include "renderer.h"
+
+enum {
+    SOFTBODY_VERTEX_COUNT = 6
+};
+
+// Packed vertex positions of many softbodies in SoA layout:
+// pX[v][b], pY[v][b] -> position of vertex v of softbody b
+struct SoftbodyPositions {
+    std::array<const float*, SOFTBODY_VERTEX_COUNT> pX;
+    std::array<const float*, SOFTBODY_VERTEX_COUNT> pY;
+    const unsigned int* pTexIdx;
+    size_t count;
+};
+
+// Writes SOFTBODY_VERTEX_COUNT fan triangles per softbody into pTriangles (softbody-major)
+// uses AVX2 or SSE2 when the CPU supports them, picked once at runtime
+void BuildSoftbodyTriangles(const SoftbodyPositions& positions, RendererTriangle* pTriangles);
+
+// Collects softbodies during a frame and emits all of their geometry in one pass
+class SoftbodyBatch {
+public:
+    SoftbodyBatch(const SoftbodyBatch&) = delete;
+    static SoftbodyBatch& GetInstance();
+    // Positions are interpolated between the last two physics steps
+    void Push(const Physics& physics, const PhysicsSoftBody& softbody, unsigned int texIdx);
+    // Appends the triangles of every pushed softbody to the renderer and clears the batch
+    void Flush();
+private:
+    SoftbodyBatch() {};
+    std::array<std::vector<float>, SOFTBODY_VERTEX_COUNT> m_x;
+    std::array<std::vector<float>, SOFTBODY_VERTEX_COUNT> m_y;
+    std::vector<unsigned int> m_texIdx;
+};
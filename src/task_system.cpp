@@ -0,0 +1,166 @@
+#include "task_system.h"
+
+#include <algorithm>
+
+struct Task {
+    TaskCallback* pCallback;
+    void* pContext;
+    std::atomic<int> pendingRangeCount;
+};
+
+// Index of the pool thread running the code, threads outside of the pool act as worker 0
+static thread_local int t_workerIndex = 0;
+
+TaskSystem::TaskSystem(int workerCount) {
+    if (workerCount <= 0)
+        workerCount = (int)std::thread::hardware_concurrency();
+    m_workerCount = std::clamp(workerCount, 1, (int)TASK_SYSTEM_MAX_WORKERS);
+
+    for (int i = 0; i < m_workerCount; i++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i < m_workerCount; i++) {
+        m_threads.emplace_back(&TaskSystem::WorkerMain, this, i);
+    }
+}
+
+TaskSystem::~TaskSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wakeCondition.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+int TaskSystem::GetWorkerCount() const {
+    return m_workerCount;
+}
+
+Task* TaskSystem::Submit(TaskCallback* pCallback, int itemCount, int minRange, void* pContext) {
+    minRange = std::max(minRange, 1);
+    // A single item is still queued: box2d submits each solver worker as its own one-item task,
+    // run inline they would go one after another on the caller
+    if (m_workerCount == 1 || itemCount < minRange) {
+        pCallback(0, itemCount, t_workerIndex, pContext);
+        return nullptr;
+    }
+    int rangeCount = std::min(m_workerCount, (itemCount + minRange - 1) / minRange);
+
+    Task* pTask;
+    {
+        std::lock_guard<std::mutex> lock(m_taskPoolMutex);
+        if (m_freeTasks.empty()) {
+            m_tasks.push_back(std::make_unique<Task>());
+            m_freeTasks.push_back(m_tasks.back().get());
+        }
+        pTask = m_freeTasks.back();
+        m_freeTasks.pop_back();
+    }
+    pTask->pCallback = pCallback;
+    pTask->pContext = pContext;
+    pTask->pendingRangeCount.store(rangeCount, std::memory_order_relaxed);
+
+    // Counted before the ranges become visible so a worker never sees the count drop below zero
+    m_queuedRangeCount.fetch_add(rangeCount);
+
+    // Even split, the first (itemCount % rangeCount) ranges get one extra item
+    int rangeSize = itemCount / rangeCount;
+    int remainder = itemCount % rangeCount;
+    unsigned int firstQueue = m_nextQueue.fetch_add(rangeCount, std::memory_order_relaxed);
+    int start = 0;
+    for (int i = 0; i < rangeCount; i++) {
+        int end = start + rangeSize + (i < remainder ? 1 : 0);
+        Queue& queue = *m_queues[(firstQueue + i) % m_workerCount];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.ranges.push_back(Range{ .pTask = pTask, .start = start, .end = end });
+        }
+        start = end;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wakeCondition.notify_all();
+
+    return pTask;
+}
+
+void TaskSystem::Wait(Task* pTask) {
+    if (pTask == nullptr)
+        return;
+
+    // Only ranges of this task are run here: the caller may be in the middle of other work
+    // that uses the same worker index
+    while (pTask->pendingRangeCount.load(std::memory_order_acquire) > 0) {
+        if (!RunRange(t_workerIndex, pTask))
+            std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> lock(m_taskPoolMutex);
+    m_freeTasks.push_back(pTask);
+}
+
+void TaskSystem::WorkerMain(int workerIndex) {
+    t_workerIndex = workerIndex;
+    int idleSpinCount = 0;
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        if (RunRange(workerIndex, nullptr)) {
+            idleSpinCount = 0;
+            continue;
+        }
+        // Tasks tend to come in bursts (e.g. the stages of a world step), so spin a little before sleeping
+        if (++idleSpinCount < TASK_SYSTEM_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeCondition.wait(lock, [this] {
+            return m_stop.load() || m_queuedRangeCount.load() > 0;
+        });
+        idleSpinCount = 0;
+    }
+}
+
+bool TaskSystem::RunRange(int workerIndex, const Task* pOnly) {
+    Range range;
+    if (!PopRange(workerIndex, pOnly, &range))
+        return false;
+
+    range.pTask->pCallback(range.start, range.end, workerIndex, range.pTask->pContext);
+    range.pTask->pendingRangeCount.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+bool TaskSystem::PopRange(int workerIndex, const Task* pOnly, Range* pRange) {
+    // Own queue first (newest range, likely still in cache), then steal the oldest ranges of the others
+    for (int i = 0; i < m_workerCount; i++) {
+        Queue& queue = *m_queues[(workerIndex + i) % m_workerCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.ranges.empty())
+            continue;
+
+        if (pOnly != nullptr) {
+            auto it = std::find_if(queue.ranges.begin(), queue.ranges.end(),
+                [pOnly](const Range& range) { return range.pTask == pOnly; });
+            if (it == queue.ranges.end())
+                continue;
+            *pRange = *it;
+            queue.ranges.erase(it);
+        }
+        else if (i == 0) {
+            *pRange = queue.ranges.back();
+            queue.ranges.pop_back();
+        }
+        else {
+            *pRange = queue.ranges.front();
+            queue.ranges.pop_front();
+        }
+        m_queuedRangeCount.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum {
+    // box2d indexes per-worker data with the worker index and supports up to 64 workers
+    TASK_SYSTEM_MAX_WORKERS = 64,
+    // Failed steal attempts before an idle worker goes to sleep
+    TASK_SYSTEM_SPIN_COUNT = 64
+};
+
+// Same signature as b2TaskCallback, so box2d tasks can be submitted as they are
+// [startIndex, endIndex) -> items to process; workerIndex is unique among concurrently running ranges
+using TaskCallback = void(int startIndex, int endIndex, uint32_t workerIndex, void* pContext);
+
+struct Task;
+
+// Work-stealing thread pool: each worker owns a queue of ranges, takes work from the back of it
+// and steals from the front of the other queues when it runs dry
+class TaskSystem {
+public:
+    // workerCount -> threads processing tasks, including the thread that waits on them
+    //                (it helps as worker 0); 0 picks the number of hardware threads
+    TaskSystem(int workerCount = 0);
+    TaskSystem(const TaskSystem&) = delete;
+    ~TaskSystem();
+    int GetWorkerCount() const;
+    // Splits [0, itemCount) into ranges of at least minRange items spread over the worker queues
+    // returns nullptr if it was run right away on the calling thread: with a single worker, or fewer than minRange items
+    Task* Submit(TaskCallback* pCallback, int itemCount, int minRange, void* pContext);
+    // Runs ranges of the task on the calling thread until all of them are done
+    void Wait(Task* pTask);
+private:
+    struct Range {
+        Task* pTask;
+        int start;
+        int end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    int m_workerCount;
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<int> m_queuedRangeCount = 0;
+    std::atomic<unsigned int> m_nextQueue = 0;
+    std::atomic<bool> m_stop = false;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeCondition;
+    // Finished tasks are recycled instead of freed
+    std::mutex m_taskPoolMutex;
+    std::vector<std::unique_ptr<Task>> m_tasks;
+    std::vector<Task*> m_freeTasks;
+
+    void WorkerMain(int workerIndex);
+    // pOnly -> if not null, only ranges of this task are taken
+    bool RunRange(int workerIndex, const Task* pOnly);
+    bool PopRange(int workerIndex, const Task* pOnly, Range* pRange);
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer, single consumer hand-off of the latest value:
+// the writer fills its own buffer and publishes it, the reader picks up the most recently
+// published one; neither side ever waits for the other and no buffer is touched by both
+template<typename T>
+class TripleBuffer {
+public:
+    // Writer side: the buffer to fill before the next Publish()
+    T& GetWriteBuffer() {
+        return m_buffers[m_writeIdx];
+    }
+    // Writer side: makes the write buffer the latest one, the previous latest becomes the write buffer
+    void Publish() {
+        uint8_t previous = m_middle.exchange(m_writeIdx | FRESH_BIT, std::memory_order_acq_rel);
+        m_writeIdx = previous & INDEX_MASK;
+    }
+    // Reader side: the latest published buffer; it stays valid until the next call
+    const T& Acquire() {
+        if (m_middle.load(std::memory_order_relaxed) & FRESH_BIT) {
+            uint8_t previous = m_middle.exchange(m_readIdx, std::memory_order_acq_rel);
+            m_readIdx = previous & INDEX_MASK;
+        }
+        return m_buffers[m_readIdx];
+    }
+private:
+    enum : uint8_t {
+        INDEX_MASK = 0x3,
+        // Set when the middle buffer holds data the reader hasn't seen
+        FRESH_BIT = 0x4
+    };
+    T m_buffers[3];
+    uint8_t m_writeIdx = 0;
+    std::atomic<uint8_t> m_middle = 1;
+    uint8_t m_readIdx = 2;
+};
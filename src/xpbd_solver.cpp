@@ -0,0 +1,281 @@
+#include "xpbd_solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include "SDL3/SDL.h"
+#include "SDL3/SDL_intrin.h"
+
+// Below this length a constraint has no direction and is skipped
+constexpr float g_minConstraintLength = 1e-6f;
+
+// One distance constraint of every softbody in a batch
+struct XpbdConstraintLanes {
+    float* pX1;
+    float* pY1;
+    float* pX2;
+    float* pY2;
+    const float* pRestLength;
+    float* pLambda;
+    const float* pInvMass;
+    const float* pCompliance;
+    size_t count;
+};
+
+// Both vertices have the same mass, so the correction is split evenly between them
+static void ProjectScalar(const XpbdConstraintLanes& lanes, size_t first, float invTimestepSq) {
+    for (size_t b = first; b < lanes.count; b++) {
+        float dx = lanes.pX2[b] - lanes.pX1[b];
+        float dy = lanes.pY2[b] - lanes.pY1[b];
+        float length = std::sqrt(dx * dx + dy * dy);
+        if (length <= g_minConstraintLength)
+            continue;
+
+        float invMass = lanes.pInvMass[b];
+        float compliance = lanes.pCompliance[b] * invTimestepSq;
+        float error = length - lanes.pRestLength[b];
+        float deltaLambda = (-error - compliance * lanes.pLambda[b]) / (2.0f * invMass + compliance);
+        lanes.pLambda[b] += deltaLambda;
+
+        float scale = deltaLambda * invMass / length;
+        lanes.pX1[b] -= scale * dx;
+        lanes.pY1[b] -= scale * dy;
+        lanes.pX2[b] += scale * dx;
+        lanes.pY2[b] += scale * dy;
+    }
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+// Same as ProjectScalar for 4 softbodies at a time, returns the index of the first one left unprocessed
+static SDL_TARGETING("sse2") size_t ProjectSSE2(const XpbdConstraintLanes& lanes, size_t first, float invTimestepSq) {
+    const __m128 minLength = _mm_set1_ps(g_minConstraintLength);
+    const __m128 invTimestepSq4 = _mm_set1_ps(invTimestepSq);
+    size_t b = first;
+    for (; b + 4 <= lanes.count; b += 4) {
+        __m128 x1 = _mm_loadu_ps(lanes.pX1 + b);
+        __m128 y1 = _mm_loadu_ps(lanes.pY1 + b);
+        __m128 x2 = _mm_loadu_ps(lanes.pX2 + b);
+        __m128 y2 = _mm_loadu_ps(lanes.pY2 + b);
+        __m128 dx = _mm_sub_ps(x2, x1);
+        __m128 dy = _mm_sub_ps(y2, y1);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        __m128 valid = _mm_cmpgt_ps(length, minLength);
+
+        __m128 invMass = _mm_loadu_ps(lanes.pInvMass + b);
+        __m128 compliance = _mm_mul_ps(_mm_loadu_ps(lanes.pCompliance + b), invTimestepSq4);
+        __m128 lambda = _mm_loadu_ps(lanes.pLambda + b);
+        __m128 error = _mm_sub_ps(length, _mm_loadu_ps(lanes.pRestLength + b));
+        __m128 numerator = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(error, _mm_mul_ps(compliance, lambda)));
+        __m128 denominator = _mm_add_ps(_mm_add_ps(invMass, invMass), compliance);
+        __m128 deltaLambda = _mm_and_ps(valid, _mm_div_ps(numerator, denominator));
+        _mm_storeu_ps(lanes.pLambda + b, _mm_add_ps(lambda, deltaLambda));
+
+        __m128 scale = _mm_div_ps(_mm_mul_ps(deltaLambda, invMass), _mm_max_ps(length, minLength));
+        __m128 offsetX = _mm_mul_ps(scale, dx);
+        __m128 offsetY = _mm_mul_ps(scale, dy);
+        _mm_storeu_ps(lanes.pX1 + b, _mm_sub_ps(x1, offsetX));
+        _mm_storeu_ps(lanes.pY1 + b, _mm_sub_ps(y1, offsetY));
+        _mm_storeu_ps(lanes.pX2 + b, _mm_add_ps(x2, offsetX));
+        _mm_storeu_ps(lanes.pY2 + b, _mm_add_ps(y2, offsetY));
+    }
+    return b;
+}
+#endif
+
+static void Project(const XpbdConstraintLanes& lanes, float invTimestepSq) {
+    size_t first = 0;
+#ifdef SDL_SSE2_INTRINSICS
+    static const bool hasSSE2 = SDL_HasSSE2();
+    if (hasSSE2)
+        first = ProjectSSE2(lanes, first, invTimestepSq);
+#endif
+    ProjectScalar(lanes, first, invTimestepSq);
+}
+
+void XpbdSolver::Add(
+    const std::span<const b2BodyId>& vertexIds,
+    const std::span<const XpbdConstraintDef>& constraints,
+    const XpbdMaterial& material
+) {
+    Batch& batch = FindBatch(vertexIds.size(), constraints);
+    for (size_t v = 0; v < batch.vertexCount; v++) {
+        b2Vec2 position = b2Body_GetPosition(vertexIds[v]);
+        batch.bodyIds[v].push_back(vertexIds[v]);
+        batch.x[v].push_back(position.x);
+        batch.y[v].push_back(position.y);
+        batch.prevX[v].push_back(position.x);
+        batch.prevY[v].push_back(position.y);
+        batch.velocityX[v].push_back(0.0f);
+        batch.velocityY[v].push_back(0.0f);
+    }
+    for (size_t c = 0; c < constraints.size(); c++) {
+        batch.restLengths[c].push_back(constraints[c].restLength);
+        batch.lambdas[c].push_back(0.0f);
+    }
+
+    // Every vertex has the same mass; a spring between two of them acts on half of it
+    float invMass = 1.0f / b2Body_GetMass(vertexIds[0]);
+    float omega = 2.0f * B2_PI * material.hertz;
+    batch.invMasses.push_back(invMass);
+    batch.compliances.push_back(2.0f * invMass / (omega * omega));
+    batch.omegas.push_back(omega);
+    batch.dampingRatios.push_back(material.dampingRatio);
+    batch.minLengths.push_back(material.minLength);
+    batch.maxLengths.push_back(material.maxLength);
+    batch.active.push_back(1);
+    batch.count++;
+}
+
+void XpbdSolver::BeginStep() {
+    for (Batch& batch : m_batches) {
+        for (size_t b = 0; b < batch.count; b++) {
+            bool awake = false;
+            for (size_t v = 0; v < batch.vertexCount; v++) {
+                awake = awake || b2Body_IsAwake(batch.bodyIds[v][b]);
+            }
+            batch.active[b] = awake && b2Body_IsEnabled(batch.bodyIds[0][b]);
+        }
+        for (size_t v = 0; v < batch.vertexCount; v++) {
+            for (size_t b = 0; b < batch.count; b++) {
+                b2Vec2 position = b2Body_GetPosition(batch.bodyIds[v][b]);
+                batch.prevX[v][b] = position.x;
+                batch.prevY[v][b] = position.y;
+            }
+        }
+    }
+}
+
+void XpbdSolver::EndStep(float timestep) {
+    for (Batch& batch : m_batches) {
+        for (size_t v = 0; v < batch.vertexCount; v++) {
+            for (size_t b = 0; b < batch.count; b++) {
+                b2Vec2 position = b2Body_GetPosition(batch.bodyIds[v][b]);
+                batch.x[v][b] = position.x;
+                batch.y[v][b] = position.y;
+            }
+        }
+
+        SolveBatch(batch, timestep);
+
+        for (size_t v = 0; v < batch.vertexCount; v++) {
+            for (size_t b = 0; b < batch.count; b++) {
+                if (!batch.active[b])
+                    continue;
+                b2BodyId bodyId = batch.bodyIds[v][b];
+                b2Body_SetTransform(bodyId, b2Vec2{ batch.x[v][b], batch.y[v][b] }, b2Body_GetRotation(bodyId));
+                b2Body_SetLinearVelocity(bodyId, b2Vec2{ batch.velocityX[v][b], batch.velocityY[v][b] });
+            }
+        }
+    }
+}
+
+void XpbdSolver::GetMovedBodies(std::vector<b2BodyId>& bodyIds) const {
+    for (const Batch& batch : m_batches) {
+        for (size_t v = 0; v < batch.vertexCount; v++) {
+            for (size_t b = 0; b < batch.count; b++) {
+                if (batch.active[b])
+                    bodyIds.push_back(batch.bodyIds[v][b]);
+            }
+        }
+    }
+}
+
+XpbdSolver::Batch& XpbdSolver::FindBatch(size_t vertexCount, const std::span<const XpbdConstraintDef>& constraints) {
+    for (Batch& batch : m_batches) {
+        if (batch.vertexCount != vertexCount || batch.vertex1.size() != constraints.size())
+            continue;
+        bool same = true;
+        for (size_t c = 0; c < constraints.size() && same; c++) {
+            same = batch.vertex1[c] == constraints[c].vertex1 && batch.vertex2[c] == constraints[c].vertex2;
+        }
+        if (same)
+            return batch;
+    }
+
+    Batch& batch = m_batches.emplace_back();
+    batch.vertexCount = vertexCount;
+    for (const auto& constraint : constraints) {
+        batch.vertex1.push_back(constraint.vertex1);
+        batch.vertex2.push_back(constraint.vertex2);
+    }
+    batch.bodyIds.resize(vertexCount);
+    batch.x.resize(vertexCount);
+    batch.y.resize(vertexCount);
+    batch.prevX.resize(vertexCount);
+    batch.prevY.resize(vertexCount);
+    batch.velocityX.resize(vertexCount);
+    batch.velocityY.resize(vertexCount);
+    batch.restLengths.resize(constraints.size());
+    batch.lambdas.resize(constraints.size());
+    return batch;
+}
+
+void XpbdSolver::SolveBatch(Batch& batch, float timestep) {
+    float invTimestep = 1.0f / timestep;
+    size_t constraintCount = batch.vertex1.size();
+
+    for (auto& lambdas : batch.lambdas) {
+        std::fill(lambdas.begin(), lambdas.end(), 0.0f);
+    }
+    for (int i = 0; i < XPBD_SOLVER_ITERATION_COUNT; i++) {
+        for (size_t c = 0; c < constraintCount; c++) {
+            uint32_t v1 = batch.vertex1[c], v2 = batch.vertex2[c];
+            Project(XpbdConstraintLanes{
+                .pX1 = batch.x[v1].data(), .pY1 = batch.y[v1].data(),
+                .pX2 = batch.x[v2].data(), .pY2 = batch.y[v2].data(),
+                .pRestLength = batch.restLengths[c].data(),
+                .pLambda = batch.lambdas[c].data(),
+                .pInvMass = batch.invMasses.data(),
+                .pCompliance = batch.compliances.data(),
+                .count = batch.count
+            }, invTimestep * invTimestep);
+        }
+    }
+
+    // Hard length limits, like the joint limits: a single rigid pass after the springs
+    for (size_t c = 0; c < constraintCount; c++) {
+        uint32_t v1 = batch.vertex1[c], v2 = batch.vertex2[c];
+        for (size_t b = 0; b < batch.count; b++) {
+            float dx = batch.x[v2][b] - batch.x[v1][b];
+            float dy = batch.y[v2][b] - batch.y[v1][b];
+            float length = std::sqrt(dx * dx + dy * dy);
+            if (length <= g_minConstraintLength)
+                continue;
+            float error = length - std::clamp(length, batch.minLengths[b], batch.maxLengths[b]);
+            float scale = 0.5f * error / length;
+            batch.x[v1][b] += scale * dx;
+            batch.y[v1][b] += scale * dy;
+            batch.x[v2][b] -= scale * dx;
+            batch.y[v2][b] -= scale * dy;
+        }
+    }
+
+    for (size_t v = 0; v < batch.vertexCount; v++) {
+        for (size_t b = 0; b < batch.count; b++) {
+            batch.velocityX[v][b] = (batch.x[v][b] - batch.prevX[v][b]) * invTimestep;
+            batch.velocityY[v][b] = (batch.y[v][b] - batch.prevY[v][b]) * invTimestep;
+        }
+    }
+
+    // Spring damping: removes part of the relative velocity along each constraint,
+    // the fraction a damper of the given ratio would remove over one step
+    for (size_t c = 0; c < constraintCount; c++) {
+        uint32_t v1 = batch.vertex1[c], v2 = batch.vertex2[c];
+        for (size_t b = 0; b < batch.count; b++) {
+            float dx = batch.x[v2][b] - batch.x[v1][b];
+            float dy = batch.y[v2][b] - batch.y[v1][b];
+            float length = std::sqrt(dx * dx + dy * dy);
+            if (length <= g_minConstraintLength)
+                continue;
+            float normalX = dx / length, normalY = dy / length;
+            float relativeSpeed =
+                (batch.velocityX[v2][b] - batch.velocityX[v1][b]) * normalX +
+                (batch.velocityY[v2][b] - batch.velocityY[v1][b]) * normalY;
+            float fraction = std::min(1.0f, 2.0f * batch.dampingRatios[b] * batch.omegas[b] * timestep);
+            float impulse = 0.5f * fraction * relativeSpeed;
+            batch.velocityX[v1][b] += impulse * normalX;
+            batch.velocityY[v1][b] += impulse * normalY;
+            batch.velocityX[v2][b] -= impulse * normalX;
+            batch.velocityY[v2][b] -= impulse * normalY;
+        }
+    }
+}
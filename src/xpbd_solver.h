@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "box2d/box2d.h"
+
+enum {
+    // Projection passes over the distance constraints per world step
+    XPBD_SOLVER_ITERATION_COUNT = 4
+};
+
+// Distance constraint between two vertices of a softbody
+struct XpbdConstraintDef {
+    uint32_t vertex1;
+    uint32_t vertex2;
+    float restLength;
+};
+
+// How a softbody's constraints behave, same meaning as the box2d distance joint fields
+struct XpbdMaterial {
+    float hertz;
+    float dampingRatio;
+    float minLength;
+    float maxLength;
+};
+
+// Position based (XPBD) solver for softbodies whose vertices are jointless box2d bodies:
+// box2d integrates the vertices and resolves their collisions with the world, then the solver
+// projects the distance constraints of every softbody and writes positions and velocities back.
+// Softbodies sharing a topology are stored in SoA arrays ([vertex][softbody]), so each constraint
+// is solved for many softbodies at once (SSE2 when available)
+class XpbdSolver {
+public:
+    // vertexIds -> dynamic bodies already in the world, one per vertex
+    // constraints -> indices refer to vertexIds
+    void Add(
+        const std::span<const b2BodyId>& vertexIds,
+        const std::span<const XpbdConstraintDef>& constraints,
+        const XpbdMaterial& material);
+    // Must be called right before b2World_Step
+    void BeginStep();
+    // Must be called right after b2World_Step with the same timestep
+    void EndStep(float timestep);
+    // Appends the vertex bodies the last EndStep moved
+    void GetMovedBodies(std::vector<b2BodyId>& bodyIds) const;
+private:
+    // Softbodies with the same vertex count and constraint connections
+    struct Batch {
+        size_t vertexCount;
+        std::vector<uint32_t> vertex1;
+        std::vector<uint32_t> vertex2;
+        size_t count = 0;
+        // [vertex][softbody]
+        std::vector<std::vector<b2BodyId>> bodyIds;
+        std::vector<std::vector<float>> x, y;
+        std::vector<std::vector<float>> prevX, prevY;
+        std::vector<std::vector<float>> velocityX, velocityY;
+        // [constraint][softbody]
+        std::vector<std::vector<float>> restLengths;
+        std::vector<std::vector<float>> lambdas;
+        // [softbody]
+        std::vector<float> invMasses;
+        // Inverse stiffness of the constraints, divided by the squared timestep when solving
+        std::vector<float> compliances;
+        std::vector<float> omegas;
+        std::vector<float> dampingRatios;
+        std::vector<float> minLengths;
+        std::vector<float> maxLengths;
+        // Asleep or disabled softbodies are left to box2d
+        std::vector<uint8_t> active;
+    };
+    std::vector<Batch> m_batches;
+
+    Batch& FindBatch(size_t vertexCount, const std::span<const XpbdConstraintDef>& constraints);
+    void SolveBatch(Batch& batch, float timestep);
+};